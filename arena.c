@@ -0,0 +1,217 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+
+#include "tvi.h"
+
+#include "arena.h"
+
+/////////////////////////////////////////////////////////////
+// row memory
+//
+// Every row used to be three or four mallocs of its own: the
+// tree node, chars, render, and hl. On a big file that is
+// millions of small blocks, each paying malloc's header and
+// rounding, and none of it goes back to the system when the
+// buffer goes away.
+//
+// Row memory now comes from here instead. Requests are rounded
+// up to a size class, 16 byte steps to 256 and then four classes
+// per doubling, and carved out of 1MB slabs. Freed blocks go on
+// a free list for their class. The caller passes the size back
+// when freeing, so blocks carry no header at all. Anything over
+// ARENA_LARGE goes to malloc, but is still tracked so
+// arenaRelease can drop the whole buffer at once.
+
+#define ARENA_SLAB (1 << 20)
+#define ARENA_SMALL 256
+#define ARENA_LARGE 65536
+#define ARENA_CLASSES 48
+#define ARENA_ALIGN 16
+
+struct arenaSlab {
+  struct arenaSlab *next;
+  size_t pad; // keep the blocks after this aligned
+};
+
+struct arenaBig {
+  struct arenaBig *next;
+  struct arenaBig *prev;
+  size_t size;
+  size_t pad;
+};
+
+static struct {
+  size_t classes[ARENA_CLASSES];
+  void *freelist[ARENA_CLASSES];
+  struct arenaSlab *slabs;
+  struct arenaBig *bigs;
+  char *bump; // unused end of the newest slab
+  char *end;
+  struct arenaStats stats;
+} A;
+
+static void arenaInitClasses() {
+  int c = 0;
+  size_t sz;
+  for (sz = ARENA_ALIGN; sz <= ARENA_SMALL; sz += ARENA_ALIGN)
+    A.classes[c++] = sz;
+  for (sz = ARENA_SMALL; sz < ARENA_LARGE; sz *= 2) {
+    A.classes[c++] = sz + sz / 4;
+    A.classes[c++] = sz + sz / 2;
+    A.classes[c++] = sz + sz / 4 * 3;
+    A.classes[c++] = sz * 2;
+  }
+}
+
+// smallest class that holds size, size must be <= ARENA_LARGE
+static int arenaClass(size_t size) {
+  if (A.classes[0] == 0)
+    arenaInitClasses();
+  if (size <= ARENA_SMALL)
+    return size ? (size - 1) / ARENA_ALIGN : 0;
+  int lo = ARENA_SMALL / ARENA_ALIGN, hi = ARENA_CLASSES - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (A.classes[mid] < size)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// what glibc malloc would have used for a block of size bytes,
+// an 8 byte header rounded up to 16 with a 32 byte minimum.
+static size_t mallocFootprint(size_t size) {
+  size_t chunk = (size + 8 + 15) & ~(size_t)15;
+  return chunk < 32 ? 32 : chunk;
+}
+
+// how much memory a request for size bytes really gets, so the
+// caller can use the slack.
+size_t arenaRound(size_t size) {
+  if (size > ARENA_LARGE)
+    return size;
+  return A.classes[arenaClass(size)];
+}
+
+void *arenaAlloc(size_t size) {
+  A.stats.blocks++;
+  if (size > ARENA_LARGE) {
+    struct arenaBig *big = malloc(sizeof(struct arenaBig) + size);
+    if (big == NULL)
+      die("arenaAlloc-malloc");
+    big->size = size;
+    big->prev = NULL;
+    big->next = A.bigs;
+    if (A.bigs)
+      A.bigs->prev = big;
+    A.bigs = big;
+    A.stats.used += size;
+    A.stats.reserved += mallocFootprint(sizeof(struct arenaBig) + size);
+    A.stats.mallocwould += mallocFootprint(size);
+    return big + 1;
+  }
+
+  int c = arenaClass(size);
+  size = A.classes[c];
+  A.stats.used += size;
+  A.stats.mallocwould += mallocFootprint(size);
+  void *p = A.freelist[c];
+  if (p) {
+    A.freelist[c] = *(void **)p;
+    return p;
+  }
+  if (A.bump == NULL || (size_t)(A.end - A.bump) < size) {
+    struct arenaSlab *slab = malloc(ARENA_SLAB);
+    if (slab == NULL)
+      die("arenaAlloc-slab");
+    slab->next = A.slabs;
+    A.slabs = slab;
+    A.bump = (char *)(slab + 1);
+    A.end = (char *)slab + ARENA_SLAB;
+    A.stats.reserved += ARENA_SLAB;
+  }
+  p = A.bump;
+  A.bump += size;
+  return p;
+}
+
+// size is what the block was allocated with, or anything else
+// arenaRound rounds the same way.
+void arenaFree(void *p, size_t size) {
+  if (p == NULL)
+    return;
+  A.stats.blocks--;
+  if (size > ARENA_LARGE) {
+    struct arenaBig *big = (struct arenaBig *)p - 1;
+    if (big->prev)
+      big->prev->next = big->next;
+    else
+      A.bigs = big->next;
+    if (big->next)
+      big->next->prev = big->prev;
+    A.stats.used -= big->size;
+    A.stats.reserved -= mallocFootprint(sizeof(struct arenaBig) + big->size);
+    A.stats.mallocwould -= mallocFootprint(big->size);
+    free(big);
+    return;
+  }
+  int c = arenaClass(size);
+  A.stats.used -= A.classes[c];
+  A.stats.mallocwould -= mallocFootprint(A.classes[c]);
+  *(void **)p = A.freelist[c];
+  A.freelist[c] = p;
+}
+
+void *arenaRealloc(void *p, size_t oldsize, size_t size) {
+  if (p && arenaRound(oldsize) == arenaRound(size) && size <= ARENA_LARGE)
+    return p;
+  void *n = arenaAlloc(size);
+  if (p) {
+    memcpy(n, p, oldsize < size ? oldsize : size);
+    arenaFree(p, oldsize);
+  }
+  return n;
+}
+
+// give back every block at once, as when the buffer is closed.
+// anything allocated before this is gone.
+void arenaRelease() {
+  while (A.slabs) {
+    struct arenaSlab *next = A.slabs->next;
+    free(A.slabs);
+    A.slabs = next;
+  }
+  while (A.bigs) {
+    struct arenaBig *next = A.bigs->next;
+    free(A.bigs);
+    A.bigs = next;
+  }
+  memset(A.freelist, 0, sizeof(A.freelist));
+  A.bump = A.end = NULL;
+  memset(&A.stats, 0, sizeof(A.stats));
+}
+
+void arenaGetStats(struct arenaStats *stats) { *stats = A.stats; }
@@ -0,0 +1,45 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+// clang-format on
+
+#ifndef FILE_ARENA_H_SEEN
+#define FILE_ARENA_H_SEEN
+////////////////////////////////
+// size classed allocator for row memory, see arena.c. blocks
+// are freed with the size they were allocated with, and all of
+// them can be released in one go when the buffer is closed.
+struct arenaStats {
+  long blocks;        // live blocks
+  size_t used;        // bytes in live blocks
+  size_t reserved;    // bytes taken from malloc, slabs included
+  size_t mallocwould; // bytes malloc would hold for the same blocks
+};
+
+extern size_t arenaRound(size_t);
+extern void *arenaAlloc(size_t);
+extern void *arenaRealloc(void *, size_t, size_t);
+extern void arenaFree(void *, size_t);
+extern void arenaRelease();
+extern void arenaGetStats(struct arenaStats *);
+
+#endif // !FILE_ARENA_H_SEEN
@@ -0,0 +1,237 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+
+#include "tvi.h"
+
+#include "bench.h"
+#include "highlight.h"
+#include "lineindex.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// benchmarks
+//
+// tvi -b <name> <file> runs a benchmark against file instead of
+// editing it and prints the results to stdout. each contender
+// is run a few times and the best time is kept, so the numbers
+// are for a warm page cache.
+
+#define BENCH_RUNS 3
+
+static double benchNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchReport(const char *what, long lines, size_t bytes,
+                        double secs) {
+  printf("%-14s %10ld lines %8.3f s %8.2f GB/s\n", what, lines, secs,
+         secs > 0 ? bytes / secs / 1e9 : 0.0);
+}
+
+// cpu cycles, where there is a counter to read. 0 if not.
+static unsigned long long benchCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// the way editorOpen used to split a file: getline one line at
+// a time and trim the line ending.
+static long benchGetline(FILE *fp) {
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+  long lines = 0;
+  rewind(fp);
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    while (linelen > 0 &&
+           (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+      linelen--;
+    lines++;
+  }
+  free(line);
+  return lines;
+}
+
+static int benchIndex(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+    fprintf(stderr, "tvi: can't benchmark %s\n", filename);
+    if (fd != -1)
+      close(fd);
+    return 1;
+  }
+  size_t len = st.st_size;
+  char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  FILE *fp = fdopen(fd, "r");
+  if (map == MAP_FAILED || fp == NULL) {
+    fprintf(stderr, "tvi: can't benchmark %s\n", filename);
+    if (map != MAP_FAILED)
+      munmap(map, len);
+    if (fp)
+      fclose(fp);
+    else
+      close(fd);
+    return 1;
+  }
+
+  printf("%s: %zu bytes, %d index thread(s)\n", filename, len,
+         editorIndexThreads(len));
+
+  double best = 0;
+  long lines = 0;
+  int j;
+  for (j = 0; j < BENCH_RUNS; j++) {
+    double t = benchNow();
+    lines = benchGetline(fp);
+    t = benchNow() - t;
+    if (j == 0 || t < best)
+      best = t;
+  }
+  benchReport("getline loop", lines, len, best);
+
+  for (j = 0; j < BENCH_RUNS; j++) {
+    size_t *offsets;
+    double t = benchNow();
+    lines = editorIndexLines(map, len, &offsets);
+    t = benchNow() - t;
+    free(offsets);
+    if (j == 0 || t < best)
+      best = t;
+  }
+  benchReport("line index", lines, len, best);
+
+  munmap(map, len);
+  fclose(fp);
+  return 0;
+}
+
+// lex every line of the file the way a fully highlighted buffer
+// would be, once stepping through each byte as the lexer used to
+// and once with the SIMD prescan, and check both come out the
+// same.
+static int benchSyntax(char *filename) {
+  E.syntax = editorSyntaxFor(filename);
+  if (E.syntax == NULL) {
+    fprintf(stderr, "tvi: no syntax for %s\n", filename);
+    return 1;
+  }
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+    fprintf(stderr, "tvi: can't benchmark %s\n", filename);
+    if (fd != -1)
+      close(fd);
+    return 1;
+  }
+  size_t len = st.st_size;
+  char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "tvi: can't benchmark %s\n", filename);
+    return 1;
+  }
+
+  // the lexer only reads render, so the rows can point straight
+  // into the file. tabs are left as they are.
+  size_t *offsets;
+  long lines = editorIndexLines(map, len, &offsets);
+  erow *rows = calloc(lines, sizeof(erow));
+  unsigned char *hl[2];
+  hl[0] = malloc(len);
+  hl[1] = malloc(len);
+  if (rows == NULL || hl[0] == NULL || hl[1] == NULL)
+    die("benchSyntax-malloc");
+  long j;
+  for (j = 0; j < lines; j++) {
+    int n = offsets[j + 1] - offsets[j];
+    while (n > 0 && (map[offsets[j] + n - 1] == '\n' ||
+                     map[offsets[j] + n - 1] == '\r'))
+      n--;
+    rows[j].render = map + offsets[j];
+    rows[j].rsize = n;
+  }
+
+  printf("%s: %zu bytes, %s syntax\n", filename, len, E.syntax->filetype);
+
+  const char *what[2] = {"byte at a time", "simd prescan"};
+  int prescan, k;
+  for (prescan = 0; prescan < 2; prescan++) {
+    double best = 0;
+    unsigned long long cycles = 0;
+    for (k = 0; k < BENCH_RUNS; k++) {
+      double t = benchNow();
+      unsigned long long c = benchCycles();
+      int open_comment = 0;
+      for (j = 0; j < lines; j++) {
+        rows[j].hl = hl[prescan] + offsets[j];
+        open_comment = editorSyntaxBench(&rows[j], open_comment, prescan);
+      }
+      c = benchCycles() - c;
+      t = benchNow() - t;
+      if (k == 0 || t < best) {
+        best = t;
+        cycles = c;
+      }
+    }
+    benchReport(what[prescan], lines, len, best);
+    if (cycles)
+      printf("%-14s %10.2f cycles a byte\n", "", (double)cycles / len);
+  }
+
+  int same = 1;
+  for (j = 0; j < lines; j++)
+    if (memcmp(hl[0] + offsets[j], hl[1] + offsets[j], rows[j].rsize))
+      same = 0;
+  if (!same)
+    printf("the highlight differs!\n");
+
+  free(hl[0]);
+  free(hl[1]);
+  free(rows);
+  free(offsets);
+  munmap(map, len);
+  return !same;
+}
+
+int editorBenchmark(char *name, char *filename) {
+  if (filename == NULL) {
+    fprintf(stderr, "tvi: -b %s needs a file\n", name);
+    return 1;
+  }
+  if (strcmp(name, "index") == 0)
+    return benchIndex(filename);
+  if (strcmp(name, "syntax") == 0)
+    return benchSyntax(filename);
+  fprintf(stderr, "tvi: unknown benchmark %s, try index or syntax\n", name);
+  return 1;
+}
@@ -0,0 +1,231 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+
+#include "tvi.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "event.h"
+#include "highlight.h"
+#include "save.h"
+#include "terminal.h"
+
+/////////////////////////////////////////////////////////////
+// waiting for something to happen
+//
+// The editor used to wake ten times a second to look for input,
+// whether or not anyone was typing. Now everything it waits on
+// is a file descriptor in one epoll set, and it sleeps in
+// epoll_wait until one of them is ready:
+//
+//   the terminal      a key
+//   a signalfd        SIGWINCH, the window changed size
+//   a timerfd         the status message is due to go away
+//   an eventfd        a worker thread has news, see editorEventWake
+//
+// Nothing wakes it while nothing happens. The events other than
+// input are dealt with here, and the screen is redrawn if they
+// changed it.
+
+static struct {
+  int epoll;
+  int sig;
+  int timer;
+  int wake;
+} Ev = {-1, -1, -1, -1};
+
+static void eventAdd(int fd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(Ev.epoll, EPOLL_CTL_ADD, fd, &ev) == -1)
+    die("eventAdd-epoll_ctl");
+}
+
+void editorEventInit() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGWINCH);
+  // threads started from here on inherit the blocked signal, so
+  // it only ever arrives through the signalfd
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+    die("editorEventInit-sigprocmask");
+
+  Ev.epoll = epoll_create1(EPOLL_CLOEXEC);
+  Ev.sig = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  Ev.timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  Ev.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (Ev.epoll == -1 || Ev.sig == -1 || Ev.timer == -1 || Ev.wake == -1)
+    die("editorEventInit");
+  eventAdd(STDIN_FILENO);
+  eventAdd(Ev.sig);
+  eventAdd(Ev.timer);
+  eventAdd(Ev.wake);
+}
+
+// have the main loop look at the workers' state. safe to call
+// from any thread.
+void editorEventWake() {
+  uint64_t one = 1;
+  if (Ev.wake != -1)
+    write(Ev.wake, &one, sizeof(one));
+}
+
+// wake up in ms milliseconds to take the status message down.
+void editorEventStatusTimer(int ms) {
+  if (Ev.timer == -1)
+    return;
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = ms / 1000;
+  its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+  timerfd_settime(Ev.timer, 0, &its, NULL);
+}
+
+static void eventResize() {
+  struct signalfd_siginfo si;
+  while (read(Ev.sig, &si, sizeof(si)) == sizeof(si))
+    ;
+  if (getWindowSize(&E.screenrows, &E.screencols) == -1)
+    die("eventResize-getWindowSize");
+  E.screenrows -= 2;
+}
+
+/////////////////////////////////////////////////////////////
+// the editor lock
+//
+// E and the rows belong to whoever holds this lock. The main
+// loop has it all the time except while it sleeps in
+// editorWaitInput, so background work (the highlighter, see
+// highlight.c) only runs while nobody is typing, and a key that
+// comes in waits for one batch of it at most.
+//
+// A plain mutex would let a thread that lets go and grabs the
+// lock again straight away starve the main loop, so background
+// work stands aside whenever the main loop is waiting.
+
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int held;          // someone has the lock
+  int waiting;       // the main loop wants it
+  int background;    // background work has it
+  unsigned int gen;  // bumped each time the main loop lets go
+  unsigned int seen; // gen when background work last let go
+} Lock = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0};
+
+void editorLock() {
+  pthread_mutex_lock(&Lock.mutex);
+  Lock.waiting++;
+  while (Lock.held)
+    pthread_cond_wait(&Lock.cond, &Lock.mutex);
+  Lock.waiting--;
+  Lock.held = 1;
+  pthread_mutex_unlock(&Lock.mutex);
+}
+
+void editorUnlock() {
+  pthread_mutex_lock(&Lock.mutex);
+  if (Lock.background)
+    Lock.seen = Lock.gen;
+  else
+    Lock.gen++;
+  Lock.held = 0;
+  Lock.background = 0;
+  pthread_cond_broadcast(&Lock.cond);
+  pthread_mutex_unlock(&Lock.mutex);
+}
+
+// take the lock for background work once nobody has it or wants
+// it. without more work left over from last time, also wait for
+// the main loop to have had the lock since, as only it can make
+// more.
+void editorLockBackground(int more) {
+  pthread_mutex_lock(&Lock.mutex);
+  while (Lock.held || Lock.waiting || (!more && Lock.gen == Lock.seen))
+    pthread_cond_wait(&Lock.cond, &Lock.mutex);
+  Lock.held = 1;
+  Lock.background = 1;
+  pthread_mutex_unlock(&Lock.mutex);
+}
+
+static long eventMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// sleep until there is input or ms milliseconds have gone by, -1
+// to wait for good, handling anything else that comes up in the
+// meantime. returns 1 if there is input. the editor lock is let
+// go while asleep.
+int editorWaitInput(int ms) {
+  long deadline = eventMillis() + ms;
+  while (1) {
+    struct epoll_event evs[4];
+    if (ms != 0)
+      editorUnlock();
+    int n = epoll_wait(Ev.epoll, evs, 4, ms);
+    if (ms != 0)
+      editorLock();
+    if (n == -1 && errno != EINTR)
+      die("editorWaitInput-epoll_wait");
+
+    int input = 0, redraw = 0;
+    int j;
+    for (j = 0; j < n; j++) {
+      int fd = evs[j].data.fd;
+      uint64_t count;
+      if (fd == STDIN_FILENO) {
+        input = 1;
+      } else if (fd == Ev.sig) {
+        eventResize();
+        redraw = 1;
+      } else if (fd == Ev.timer) {
+        read(Ev.timer, &count, sizeof(count));
+        redraw = 1;
+      } else if (fd == Ev.wake) {
+        read(Ev.wake, &count, sizeof(count));
+        redraw |= editorSavePoll();
+        redraw |= editorSyntaxPoll();
+      }
+    }
+    if (redraw)
+      editorRefreshScreen();
+    if (input)
+      return 1;
+    if (ms >= 0) {
+      ms = deadline - eventMillis();
+      if (ms <= 0)
+        return 0;
+    }
+  }
+}
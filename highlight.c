@@ -22,7 +22,17 @@
 //
 
 #include "tvi.h"
-#include "highlight.h" 
+
+#include <pthread.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "event.h"
+#include "highlight.h"
+#include "rowscreen.h"
+#include "rowstore.h"
 
 // canned filetype extensions
 char *C_HL_extensions[] = {".c", ".h", ".cpp", ".C", ".H", ".CPP", NULL};
@@ -33,9 +43,8 @@ char *Text_HL_extensions[] = {".txt", ".TXT", NULL};
 
 // keywords originally supported two tiers of keywords. For C it was broken
 // down by keywords and common types. types were originally flagged by a suffix
-// pipe symbol, but that causes problems once operators are added to the keyword
-// lists. Now a suffix of \xff is used. Still to come is a third tier for
-// operators.
+// pipe symbol, but that caused problems when operators were in the keyword
+// lists. Now a suffix of \xff is used. Operators have lists of their own.
 //
 // All the highlight chunking needs to work from larger to smaller chunks,
 // so the larger supersedes the smaller. For example, comments wrapping
@@ -44,8 +53,9 @@ char *Text_HL_extensions[] = {".txt", ".TXT", NULL};
 // Also, tokens with the same prefix should work from longer to smaller.
 // If not, ! comes before != and this leaves the = not highlighted.
 //
-// At load time, the keyword tables are sorted alphabetically and then
-// a fixup pass is done so that the cases like ! != are reversed.
+// At load time, the keyword tables are checked for duplicates and
+// compiled into a trie. The lookup takes the longest keyword that
+// ends at a separator.
 //
 // TODO: preprocessor directives start a line, ... test for this.
 // TODO: currently preprocessor directs are entered both with and
@@ -58,12 +68,7 @@ char *C_HL_Keywords[] = {"switch",     "if",       "while",
                          "include",    "define",   "NULL",
                          "#include",   "#define",  "ifdef",
                          "#ifdef",     "#then",    "#",
-                         "namespace",  "!",        "!=",
-                         "=",          "<",        ">",
-                         "->",         "<<",       ">>",
-                         "==",         "&&",       "|",
-                         "||",         "|=",       "&",
-                         "&=",
+                         "namespace",
 
                          "int\xff",    "long\xff", "double\xff",
                          "float\xff",  "char\xff", "unsigned\xff",
@@ -96,6 +101,25 @@ char *Markdown_HL_Keywords[] = {NULL};
 
 char *Text_HL_Keywords[] = {NULL};
 
+// Operators are found wherever they start, with or without blanks
+// around them, and the longest one wins, so a->b is one operator
+// and not a minus. Like keywords they are compiled into a trie at
+// load time. None may hold a quote or comment delimiter past its
+// first character, see syntaxScan.
+char *C_HL_Operators[] = {"+",  "-",  "*",   "/",   "%",  "++", "--", "=",
+                          "+=", "-=", "*=",  "/=",  "%=", "==", "!=", "!",
+                          "<",  ">",  "<=",  ">=",  "<<", ">>", "<<=", ">>=",
+                          "&",  "&&", "&=",  "|",   "||", "|=", "^",  "^=",
+                          "~",  "->", "?",   ":",   NULL};
+
+char *Pascal_HL_Operators[] = {":=", "+", "-",  "*",  "/",  "=", "<>",
+                               "<",  ">", "<=", ">=", "^",  "@", NULL};
+
+char *Python_HL_Operators[] = {
+    "+",  "-",  "*",  "**",  "/",   "//",  "%",   "@",  "=",  "==", "!=", "<",
+    ">",  "<=", ">=", "<<",  ">>",  "&",   "|",   "^",  "~",  "+=", "-=", "*=",
+    "/=", "//=", "%=", "**=", "&=", "|=", "^=", ">>=", "<<=", "->", ":=", NULL};
+
 // clang-format off
 // syntax highlighting definitions
 struct editorSyntax HLDB[] = {
@@ -103,6 +127,7 @@ struct editorSyntax HLDB[] = {
     {"C",
     C_HL_extensions,
     C_HL_Keywords,
+    C_HL_Operators,
     0,
     1,
     "//",
@@ -111,11 +136,15 @@ struct editorSyntax HLDB[] = {
     HL_HIGHLIGHT_NUMBERS
     | HL_HIGHLIGHT_STRINGS
     | HL_HIGHLIGHT_COMMENT
-    | HL_HIGHLIGHT_KEYWORDS},
+    | HL_HIGHLIGHT_KEYWORDS
+    | HL_HIGHLIGHT_OPERATORS,
+    NULL,
+    NULL},
 
     {"Pascal",
     Pascal_HL_extensions,
     Pascal_HL_Keywords,
+    Pascal_HL_Operators,
     0,
     0,
     "//",
@@ -124,11 +153,15 @@ struct editorSyntax HLDB[] = {
     HL_HIGHLIGHT_NUMBERS
     | HL_HIGHLIGHT_STRINGS
     | HL_HIGHLIGHT_COMMENT
-    | HL_HIGHLIGHT_KEYWORDS},
+    | HL_HIGHLIGHT_KEYWORDS
+    | HL_HIGHLIGHT_OPERATORS,
+    NULL,
+    NULL},
 
     {"Python",
     Python_HL_extensions,
     Python_HL_Keywords,
+    Python_HL_Operators,
     0,
     1,
     "#",
@@ -137,28 +170,37 @@ struct editorSyntax HLDB[] = {
     HL_HIGHLIGHT_NUMBERS
     | HL_HIGHLIGHT_STRINGS
     | HL_HIGHLIGHT_COMMENT
-    | HL_HIGHLIGHT_KEYWORDS},
+    | HL_HIGHLIGHT_KEYWORDS
+    | HL_HIGHLIGHT_OPERATORS,
+    NULL,
+    NULL},
 
     {"Markdown",
     Markdown_HL_extensions,
     Markdown_HL_Keywords,
+    NULL,
     0,
     0,
     NULL,
     NULL,
     NULL,
-    0},
+    0,
+    NULL,
+    NULL},
 
     {"Text",
     Text_HL_extensions,
     Text_HL_Keywords,
+    NULL,
     0,
     0,
     NULL,
     NULL,
     NULL,
     HL_HIGHLIGHT_NUMBERS
-    | HL_HIGHLIGHT_PUNCTUATION}
+    | HL_HIGHLIGHT_PUNCTUATION,
+    NULL,
+    NULL}
   };
 
 #define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
@@ -167,85 +209,308 @@ struct editorSyntax HLDB[] = {
 //////////////////////////////////////////////////////////////
 // initialization of keyword tabls
 
+// character classes for the lexer
+int is_punctuation(int c) { return strchr(".,():;[]!?", c) != 0; }
+
+int is_separator(int c) {
+  return isspace(c) || c == '\0' || strchr("\"\',.()+-/*=~%<>[];", c) != NULL;
+}
+
 // sort comparison helper
 static int cmpstringp(const void *p1, const void *p2) {
   return strcmp(*(char *const *)p1, *(char *const *)p2);
 }
 
-// Sort and massage keyword tables for syntax highlighting. Also
-// check for duplicate entries in a table and report an error if
-// found.
-void initializeKeywordTables() {
-  unsigned int i;
-  for (i = 0; i < HLDB_ENTRIES; i++) {
-    if (HLDB[i].keywords) {
-      int j = 0;
-      while (HLDB[i].keywords[j])
-        j++;
-      HLDB[i].keywordCount = j;
-
-      // allocate room for the whole list -and- the trailing
-      // null entry.
-      size_t k = (j + 1) * sizeof(HLDB[i].keywords[0]);
-      char **kw_copy = malloc(k);
-      if (!kw_copy)
-        die("initEditor-malloc");
-      memcpy(kw_copy, HLDB[i].keywords, k);
-
-      // do not include trailing null entry in sort
-      qsort(kw_copy, j, sizeof(char *), cmpstringp);
-
-      // Sort single character operators behind the double character variants
-      // so that they highlight correctly. So, << in front of <, and so on.
-      int fixed = 1;
-      while (fixed) {
-        fixed = 0;
-        for (j = 0; j < HLDB[i].keywordCount - 1; j++) {
-          if (strlen(kw_copy[j]) == (strlen(kw_copy[j + 1]) - 1)) {
-            if (strncmp(kw_copy[j], kw_copy[j + 1], strlen(kw_copy[j])) == 0) {
-              fixed = 1;
-              void *temp;
-              temp = kw_copy[j];
-              kw_copy[j] = kw_copy[j + 1];
-              kw_copy[j + 1] = temp;
-            }
-          }
-        }
-      }
+// The keywords for a syntax are compiled into a trie, walked one
+// byte of the token at a time, so a lookup costs the length of the
+// token and not the number of keywords. The operators get one too.
+//
+// Only a few dozen different bytes show up in any keyword list,
+// so bytes are first mapped to a small column number and each node
+// is a row of next nodes by column. Bytes that are in no keyword
+// map to column 0, which never leads anywhere. For a language that
+// ignores case both cases of a letter map to the same column.
+// Node 0 is the root, and since nothing points back at the root
+// a next of 0 means no edge.
+struct keywordTrie {
+  unsigned char col[256];
+  int ncols;
+  int nnodes;
+  int *next;            // nnodes rows of ncols
+  unsigned char *match; // the highlight if a word ends here
+};
+
+// words with a \xff suffix are the second tier of keywords, the
+// rest get highlight hl.
+static struct keywordTrie *keywordCompile(char **keywords, int count,
+                                          int caseSensitive, int hl) {
+  struct keywordTrie *t = calloc(1, sizeof(struct keywordTrie));
+  if (!t)
+    die("keywordCompile-calloc");
+
+  // give each byte used a column, folding case if asked
+  int maxnodes = 1;
+  int j, k;
+  t->ncols = 1;
+  for (j = 0; j < count; j++) {
+    for (k = 0; keywords[j][k] && keywords[j][k] != '\xff'; k++) {
+      unsigned char c = keywords[j][k];
+      if (!caseSensitive)
+        c = tolower(c);
+      if (t->col[c] == 0)
+        t->col[c] = t->ncols++;
+      maxnodes++;
+    }
+  }
+  if (!caseSensitive) {
+    int c;
+    for (c = 'a'; c <= 'z'; c++)
+      t->col[toupper(c)] = t->col[c];
+  }
 
-      // Check for duplicate keywords and error out if any are found.
-      for (j = 0; j < HLDB[i].keywordCount - 1; j++) {
-        if (strcmp(kw_copy[j], kw_copy[j + 1]) == 0) {
-          char errmsg[80];
-          snprintf(errmsg, 79, "duplicate keyword in syntax table for %s '%s'",
-                   HLDB[i].filetype, kw_copy[j]);
-          errno = EINVAL;
-          die(errmsg);
-        }
-      }
+  t->next = calloc((size_t)maxnodes * t->ncols, sizeof(int));
+  t->match = calloc(maxnodes, 1);
+  if (!t->next || !t->match)
+    die("keywordCompile-calloc");
+
+  // a keyword listed in both tiers (Pascal's type) shows as the
+  // second, as it always has.
+  t->nnodes = 1;
+  for (j = 0; j < count; j++) {
+    int node = 0;
+    for (k = 0; keywords[j][k] && keywords[j][k] != '\xff'; k++) {
+      int *next = &t->next[node * t->ncols +
+                           t->col[(unsigned char)keywords[j][k]]];
+      if (*next == 0)
+        *next = t->nnodes++;
+      node = *next;
+    }
+    if (node && t->match[node] != HL_KEYWORD2)
+      t->match[node] = keywords[j][k] ? HL_KEYWORD2 : hl;
+  }
+  return t;
+}
 
-      HLDB[i].keywords = kw_copy;
+// the length of the longest word starting at s, and its highlight
+// in *hl. 0 if there isn't one. a keyword has to be followed by a
+// separator or the end of the text, an operator (sep 0) doesn't.
+static int keywordMatch(struct keywordTrie *t, const char *s, int len,
+                        int sep, unsigned char *hl) {
+  int node = 0;
+  int found = 0;
+  int k;
+  for (k = 0; k < len; k++) {
+    int col = t->col[(unsigned char)s[k]];
+    if (col == 0)
+      break;
+    node = t->next[node * t->ncols + col];
+    if (node == 0)
+      break;
+    if (t->match[node] &&
+        (!sep || k + 1 == len || is_separator((unsigned char)s[k + 1]))) {
+      found = k + 1;
+      *hl = t->match[node];
     }
   }
+  return found;
+}
+
+// sort a copy of a NULL terminated word list, make sure no word is
+// in it twice, and compile it. count gets the number of words.
+static struct keywordTrie *compileWords(struct editorSyntax *s, char ***words,
+                                        int *count, int hl) {
+  int j = 0;
+  while ((*words)[j])
+    j++;
+  *count = j;
+  if (j == 0)
+    return NULL;
+
+  // allocate room for the whole list -and- the trailing
+  // null entry.
+  size_t k = (j + 1) * sizeof((*words)[0]);
+  char **kw_copy = malloc(k);
+  if (!kw_copy)
+    die("initEditor-malloc");
+  memcpy(kw_copy, *words, k);
+
+  // do not include trailing null entry in sort
+  qsort(kw_copy, j, sizeof(char *), cmpstringp);
+
+  // Check for duplicate keywords and error out if any are found.
+  for (j = 0; j < *count - 1; j++) {
+    if (strcmp(kw_copy[j], kw_copy[j + 1]) == 0) {
+      char errmsg[80];
+      snprintf(errmsg, 79, "duplicate %s in syntax table for %s '%s'",
+               hl == HL_OPERATOR ? "operator" : "keyword", s->filetype,
+               kw_copy[j]);
+      errno = EINVAL;
+      die(errmsg);
+    }
+  }
+
+  *words = kw_copy;
+  return keywordCompile(kw_copy, *count, s->keywordsCaseSensitive, hl);
+}
+
+// Check the keyword tables for duplicate entries and report an
+// error if any are found, then compile each into its trie.
+void initializeKeywordTables() {
+  unsigned int i;
+  int count;
+  for (i = 0; i < HLDB_ENTRIES; i++) {
+    if (HLDB[i].keywords)
+      HLDB[i].trie = compileWords(&HLDB[i], &HLDB[i].keywords,
+                                  &HLDB[i].keywordCount, HL_KEYWORD1);
+    if (HLDB[i].operators)
+      HLDB[i].optrie =
+          compileWords(&HLDB[i], &HLDB[i].operators, &count, HL_OPERATOR);
+  }
 }
 
 ///////////////////////////////////////////////////////////
 // syntax highlighting
 
-int is_punctuation(int c) { return strchr(".,():;[]!?", c) != 0; }
-
-int is_separator(int c) {
-  return isspace(c) || c == '\0' || strchr("\"\',.()+-/*=~%<>[];", c) != NULL;
+// Most of a row is runs the lexer does nothing with: the rest of
+// an identifier, the inside of a comment or a string, blanks.
+// Walking those one char at a time through every test below is
+// where the time went, so the runs are found ahead of the lexer
+// 16 or 32 bytes at a time with SIMD and filled in all at once.
+// The lexer only steps through the bytes where something can
+// happen.
+//
+// A byte is inert if, after a plain byte that isn't a separator,
+// it leaves the lexer in the same state: not a separator, a
+// quote, or the first byte of a comment, operator, or
+// punctuation mark. Identifier bytes usually are, and are tested
+// for with SIMD when they all are for the syntax.
+
+enum lexRunKind {
+  LEX_WORD,  // inert bytes
+  LEX_UNTIL, // anything but a or b
+  LEX_WHILE  // only a
+};
+
+static const struct editorSyntax *lexSyntax;
+static unsigned char lexInert[256];
+static int lexWordSimd;
+static int lexPrescan = 1;
+
+static void lexPrepare() {
+  struct editorSyntax *syn = E.syntax;
+  struct keywordTrie *op = syn->optrie;
+  char *starts[] = {syn->lineCommentStart, syn->blockCommentStart};
+  int c, j;
+
+  for (c = 0; c < 256; c++) {
+    lexInert[c] = !is_separator(c) && c != '"' && c != '\'';
+    if (op && (op->col[c] || op->col[tolower(c)]))
+      lexInert[c] = 0;
+    if (syn->flags & HL_HIGHLIGHT_PUNCTUATION && is_punctuation(c))
+      lexInert[c] = 0;
+  }
+  for (j = 0; j < 2; j++)
+    if (starts[j] && starts[j][0])
+      lexInert[(unsigned char)starts[j][0]] = 0;
+
+  lexWordSimd = 1;
+  for (c = 0; c < 256; c++)
+    if ((isalnum(c) || c == '_' || c >= 0x80) && !lexInert[c])
+      lexWordSimd = 0;
+  lexSyntax = syn;
 }
 
-void editorUpdateSyntax(erow *row) {
-  row->hl = realloc(row->hl, row->rsize);
-  memset(row->hl, HL_NORMAL, row->size);
+#if defined(__AVX2__)
+#define LEX_BLOCK 32
+// a bit for each of the 32 bytes at s that ends the run
+static uint32_t lexMask(const char *s, int kind, char a, char b) {
+  __m256i v = _mm256_loadu_si256((const __m256i *)s);
+  __m256i m;
+  if (kind == LEX_WORD) {
+    __m256i l = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    m = _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), l));
+    m = _mm256_or_si256(
+        m, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    m = _mm256_or_si256(m, _mm256_cmpgt_epi8(_mm256_setzero_si256(), v));
+    return ~(uint32_t)_mm256_movemask_epi8(m);
+  }
+  m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(a));
+  if (kind == LEX_WHILE)
+    return ~(uint32_t)_mm256_movemask_epi8(m);
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+  return (uint32_t)_mm256_movemask_epi8(m);
+}
+#elif defined(__SSE2__)
+#define LEX_BLOCK 16
+// a bit for each of the 16 bytes at s that ends the run
+static uint32_t lexMask(const char *s, int kind, char a, char b) {
+  __m128i v = _mm_loadu_si128((const __m128i *)s);
+  __m128i m;
+  if (kind == LEX_WORD) {
+    __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    m = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)));
+    m = _mm_or_si128(
+        m, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    m = _mm_or_si128(m, _mm_cmplt_epi8(v, _mm_setzero_si128()));
+    return ~_mm_movemask_epi8(m) & 0xffff;
+  }
+  m = _mm_cmpeq_epi8(v, _mm_set1_epi8(a));
+  if (kind == LEX_WHILE)
+    return ~_mm_movemask_epi8(m) & 0xffff;
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+  return _mm_movemask_epi8(m);
+}
+#endif
 
-  if (E.syntax == NULL)
-    return;
+// how many bytes at the start of s, up to len, make a run of kind.
+static int lexRun(const char *s, int len, int kind, char a, char b) {
+  int i = 0;
+#if defined(LEX_BLOCK)
+  if (kind != LEX_WORD || lexWordSimd) {
+    for (; i + LEX_BLOCK <= len; i += LEX_BLOCK) {
+      uint32_t m = lexMask(&s[i], kind, a, b);
+      if (m)
+        return i + __builtin_ctz(m);
+    }
+  }
+#endif
+  switch (kind) {
+  case LEX_WORD:
+    while (i < len && lexInert[(unsigned char)s[i]])
+      i++;
+    break;
+  case LEX_UNTIL:
+    while (i < len && s[i] != a && s[i] != b)
+      i++;
+    break;
+  case LEX_WHILE:
+    while (i < len && s[i] == a)
+      i++;
+    break;
+  }
+  return i;
+}
 
-  char **keywords = E.syntax->keywords;
+// Run the highlighter over a row starting at column i, with
+// in_comment the block comment state coming into that column.
+//
+// Past column stop, the old highlight is still in hl for the
+// rest of the row. A blank that was plain text there, reached
+// while outside any string or comment, leaves the lexer in the
+// same state it was in last time, so nothing after it can come
+// out different and we quit early. Returns 1 if the lexer ran to
+// the end of the row, with the final comment state in
+// *open_comment.
+static int syntaxLex(erow *row, int i, int in_comment, int stop,
+                     int *open_comment) {
+  struct keywordTrie *trie = E.syntax->trie;
+  struct keywordTrie *optrie = E.syntax->optrie;
 
   char *scs = E.syntax->lineCommentStart;
   char *mcs = E.syntax->blockCommentStart;
@@ -257,16 +522,22 @@ void editorUpdateSyntax(erow *row) {
 
   int prev_sep = 1;
   int in_string = 0;
-  int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
 
-  int i = 0;
+  if (lexPrescan && lexSyntax != E.syntax)
+    lexPrepare();
+
   while (i < row->rsize) {
     char c = row->render[i];
     unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
 
+    if (i >= stop && !in_string && !in_comment &&
+        isspace((unsigned char)c) && row->hl[i] == HL_NORMAL)
+      return 0;
+
     if (E.syntax->flags & HL_HIGHLIGHT_COMMENT) {
       if (scs_len && !in_string && !in_comment) {
-        if (!strncmp(&row->render[i], scs, scs_len)) {
+        if (c == scs[0] && row->rsize - i >= scs_len &&
+            !strncmp(&row->render[i], scs, scs_len)) {
           memset(&row->hl[i], HL_COMMENT, row->rsize - i);
           break;
         }
@@ -275,7 +546,8 @@ void editorUpdateSyntax(erow *row) {
       if (mcs_len && mce_len && !in_string) {
         if (in_comment) {
           row->hl[i] = HL_MLCOMMENT;
-          if (!strncmp(&row->render[i], mce, mce_len)) {
+          if (c == mce[0] && row->rsize - i >= mce_len &&
+              !strncmp(&row->render[i], mce, mce_len)) {
             memset(&row->hl[i], HL_MLCOMMENT, mce_len);
             i += mce_len;
             in_comment = 0;
@@ -283,9 +555,16 @@ void editorUpdateSyntax(erow *row) {
             continue;
           } else {
             i++;
+            if (lexPrescan) {
+              int n = lexRun(&row->render[i], row->rsize - i, LEX_UNTIL,
+                             mce[0], mce[0]);
+              memset(&row->hl[i], HL_MLCOMMENT, n);
+              i += n;
+            }
             continue;
           }
-        } else if (!strncmp(&row->render[i], mcs, mcs_len)) {
+        } else if (c == mcs[0] && row->rsize - i >= mcs_len &&
+                   !strncmp(&row->render[i], mcs, mcs_len)) {
           memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
           i += mcs_len;
           in_comment = 1;
@@ -297,7 +576,7 @@ void editorUpdateSyntax(erow *row) {
     if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
       if (in_string) {
         row->hl[i] = HL_STRING;
-        if (c == '\\' && i + 1 < row->size) {
+        if (c == '\\' && i + 1 < row->rsize) {
           row->hl[i + 1] = HL_STRING;
           i += 2;
           continue;
@@ -306,6 +585,12 @@ void editorUpdateSyntax(erow *row) {
           in_string = 0;
         i++;
         prev_sep = 1;
+        if (lexPrescan && in_string) {
+          int n = lexRun(&row->render[i], row->rsize - i, LEX_UNTIL,
+                         in_string, '\\');
+          memset(&row->hl[i], HL_STRING, n);
+          i += n;
+        }
         continue;
       } else {
         if (c == '"' || c == '\'') {
@@ -327,39 +612,29 @@ void editorUpdateSyntax(erow *row) {
       }
     }
 
-    if (prev_sep && E.syntax->flags & HL_HIGHLIGHT_KEYWORDS) {
-      int j;
-      for (j = 0; keywords[j]; j++) {
-
-        // TODO: is it worth doing this at init time as well? create a
-        // smarter list for the lookup?
-        int klen = strlen(keywords[j]);
-        int kw2 = keywords[j][klen - 1] == '\xff';
-        if (kw2)
-          klen--;
-
-        int not_found = (E.syntax->keywordsCaseSensitive
-                             ? strncmp(&row->render[i], keywords[j], klen)
-                             : strncasecmp(&row->render[i], keywords[j], klen));
-        if (!not_found && is_separator(row->render[i + klen])) {
-          memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-          i += klen;
-          break;
-        }
-      }
-      if (keywords[j] != NULL) {
+    if (prev_sep && trie && E.syntax->flags & HL_HIGHLIGHT_KEYWORDS) {
+      unsigned char kw;
+      int klen = keywordMatch(trie, &row->render[i], row->rsize - i, 1, &kw);
+      if (klen) {
+        memset(&row->hl[i], kw, klen);
+        i += klen;
         prev_sep = 0;
         continue;
       }
     }
 
-    // first attempt at operators, depending on the
-    // coding standards and langauge, there may not
-    // be any prior seperator.
-    if (E.syntax->flags & HL_HIGHLIGHT_OPERATORS) {
-      /* TODO: need to implement, note that by relying on
-           prev_sep we're not going to get operators without
-           whitespace around them. */
+    // operators don't need a separator on either side, a+b is
+    // three tokens. the longest operator wins, so a->b never
+    // shows a minus.
+    if (optrie && E.syntax->flags & HL_HIGHLIGHT_OPERATORS) {
+      unsigned char op;
+      int olen = keywordMatch(optrie, &row->render[i], row->rsize - i, 0, &op);
+      if (olen) {
+        memset(&row->hl[i], op, olen);
+        i += olen;
+        prev_sep = 1;
+        continue;
+      }
     }
 
     // first attempt at punctuation, checking for prior
@@ -378,16 +653,262 @@ void editorUpdateSyntax(erow *row) {
       }
     }
 
+    row->hl[i] = HL_NORMAL;
     prev_sep = is_separator(c);
     i++;
+    if (lexPrescan && i < row->rsize) {
+      // blanks only up to stop, past it each one may end the lex
+      int n = 0;
+      if (!prev_sep && lexInert[(unsigned char)row->render[i]])
+        n = lexRun(&row->render[i], row->rsize - i, LEX_WORD, 0, 0);
+      else if (c == ' ' && row->render[i] == ' ' && i < stop)
+        n = lexRun(&row->render[i], (stop < row->rsize ? stop : row->rsize) - i,
+                   LEX_WHILE, ' ', 0);
+      memset(&row->hl[i], HL_NORMAL, n);
+      i += n;
+    }
+  }
+
+  *open_comment = in_comment;
+  return 1;
+}
+
+// a row's closing comment state feeds the next row, so when it
+// changes the next row needs another look, and so on down until
+// a row comes out in the state it had before. rows past the lexed
+// part of the file will get theirs when they are shown.
+//
+// only rows on the screen are done here. opening a comment at the
+// top of a big file would otherwise relex all of it on the spot,
+// so off the screen the frontier is pulled back instead and the
+// rest waits for editorPrepareRow.
+static void syntaxSetOpenComment(erow *row, int open_comment) {
+  int at = -1;
+  while (row->hl_open_comment != open_comment) {
+    row->hl_open_comment = open_comment;
+    if (at < 0)
+      at = editorRowIndex(row);
+    at++;
+    if (at >= E.hlfrontier)
+      return;
+    if (at < E.rowoff || at >= E.rowoff + E.screenrows) {
+      E.hlresume = E.hlfrontier;
+      E.hlfrontier = at;
+      return;
+    }
+    row = editorRowNext(row);
+    if (row->render == NULL)
+      editorRenderRow(row);
+    syntaxLex(row, 0, open_comment, row->rsize + 1, &open_comment);
+  }
+}
+
+// The comment state a row ends in, worked out from chars without
+// building render or hl. Only comments and strings move it, and
+// no keyword or operator holds a quote or comment delimiter, so
+// the scan can skip from one byte that might start either to the
+// next.
+static const struct editorSyntax *scanSyntax;
+static unsigned char scanStart[256];
+
+static int syntaxScan(const char *s, int len, int in_comment) {
+  struct editorSyntax *syn = E.syntax;
+  int comments = syn->flags & HL_HIGHLIGHT_COMMENT;
+  int strings = syn->flags & HL_HIGHLIGHT_STRINGS;
+  char *scs = comments ? syn->lineCommentStart : NULL;
+  char *mcs = comments ? syn->blockCommentStart : NULL;
+  char *mce = comments ? syn->blockCommentEnd : NULL;
+  int scs_len = scs ? strlen(scs) : 0;
+  int mcs_len = mcs && mce ? strlen(mcs) : 0;
+  int mce_len = mcs && mce ? strlen(mce) : 0;
+
+  if (scanSyntax != syn) {
+    memset(scanStart, 0, sizeof(scanStart));
+    if (scs_len)
+      scanStart[(unsigned char)scs[0]] = 1;
+    if (mcs_len)
+      scanStart[(unsigned char)mcs[0]] = 1;
+    if (strings)
+      scanStart['"'] = scanStart['\''] = 1;
+    scanSyntax = syn;
+  }
+  if (mcs_len == 0)
+    in_comment = 0;
+
+  int in_string = 0;
+  int i = 0;
+  while (i < len) {
+    if (in_comment) {
+      char *end = memmem(&s[i], len - i, mce, mce_len);
+      if (end == NULL)
+        return 1;
+      i = end - s + mce_len;
+      in_comment = 0;
+      continue;
+    }
+    if (in_string) {
+      if (s[i] == '\\' && i + 1 < len) {
+        i += 2;
+        continue;
+      }
+      if (s[i] == in_string)
+        in_string = 0;
+      i++;
+      continue;
+    }
+    while (i < len && !scanStart[(unsigned char)s[i]])
+      i++;
+    if (i == len)
+      break;
+    if (scs_len && len - i >= scs_len && !memcmp(&s[i], scs, scs_len))
+      return 0;
+    if (mcs_len && len - i >= mcs_len && !memcmp(&s[i], mcs, mcs_len)) {
+      i += mcs_len;
+      in_comment = 1;
+      continue;
+    }
+    if (strings && (s[i] == '"' || s[i] == '\''))
+      in_string = s[i];
+    i++;
   }
+  return in_comment;
+}
 
-  int changed = (row->hl_open_comment != in_comment);
-  row->hl_open_comment = in_comment;
-  if (changed && row->idx + 1 < E.numrows)
-    editorUpdateSyntax(&E.row[row->idx + 1]);
+// set the comment state a row ends in for a row that is only
+// being passed over on the way to another, see editorPrepareRow.
+void editorScanSyntax(erow *row) {
+  if (E.syntax == NULL) {
+    row->hl_open_comment = 0;
+    return;
+  }
+  erow *prev = editorRowPrev(row);
+  row->hl_open_comment = syntaxScan(editorRowChars(row), row->size,
+                                    prev && prev->hl_open_comment);
 }
 
+// lex a row the frontier hasn't reached yet with the state the
+// row above has now, leaving the row's own state alone. rows there
+// may still be vouched for by E.hlresume, and then hl has to agree
+// with the state they have.
+void editorLexAhead(erow *row) {
+  if (E.syntax == NULL) {
+    memset(row->hl, HL_NORMAL, row->rsize);
+    return;
+  }
+  erow *prev = editorRowPrev(row);
+  int open_comment;
+  syntaxLex(row, 0, prev && prev->hl_open_comment, row->rsize + 1,
+            &open_comment);
+}
+
+void editorUpdateSyntax(erow *row) {
+  if (E.syntax == NULL) {
+    memset(row->hl, HL_NORMAL, row->rsize);
+    row->hl_open_comment = 0;
+    return;
+  }
+
+  erow *prev = editorRowPrev(row);
+  int open_comment;
+  syntaxLex(row, 0, prev && prev->hl_open_comment, row->rsize + 1,
+            &open_comment);
+  syntaxSetOpenComment(row, open_comment);
+}
+
+// render columns at through at + oldlen were replaced by newlen
+// new ones and the rest of the row slid over to make room. hl
+// is still laid out the old way. Shift the old highlight of the
+// tail into place and relex only what the edit can reach: from
+// the last plain blank before the edit, where the lexer state is
+// known, until the highlight settles back into the old one.
+void editorUpdateSyntaxSpan(erow *row, int at, int oldlen, int newlen) {
+  int oldrsize = row->rsize - newlen + oldlen;
+  memmove(&row->hl[at + newlen], &row->hl[at + oldlen],
+          oldrsize - at - oldlen);
+
+  if (E.syntax == NULL) {
+    memset(&row->hl[at], HL_NORMAL, newlen);
+    return;
+  }
+
+  int from = at - 1;
+  while (from > 0 && !(isspace((unsigned char)row->render[from]) &&
+                       row->hl[from] == HL_NORMAL))
+    from--;
+
+  int in_comment = 0;
+  if (from <= 0) {
+    erow *prev = editorRowPrev(row);
+    from = 0;
+    in_comment = prev && prev->hl_open_comment;
+  }
+
+  int open_comment;
+  if (syntaxLex(row, from, in_comment, at + newlen, &open_comment))
+    syntaxSetOpenComment(row, open_comment);
+}
+
+/////////////////////////////////////////////////////////////
+// the highlighter thread
+//
+// Rows past E.hlfrontier are drawn plain until it gets to them.
+// In the background a worker keeps moving the frontier down the
+// file TVI_HL_BATCH rows at a time, taking the editor lock only
+// while the main loop is asleep, see event.c. By the time anyone
+// jumps far into a big file the rows there usually know their
+// state already, and nothing the user does waits for the whole
+// file to be lexed.
+//
+// This is lookahead in file order only, there is no queue of
+// dirty rows and the screen doesn't go first. A jump the worker
+// hasn't reached stays plain until it has lexed everything above,
+// and the relex after an edit, see editorUpdateSyntaxSpan, still
+// happens on the main thread.
+//
+// When the rows on the screen that went out plain have been
+// reached the main loop is woken to draw them again.
+
+static int syntaxShown() {
+  int end = E.rowoff + E.screenrows;
+  return end < E.numrows ? end : E.numrows;
+}
+
+static void *syntaxWorker(void *unused) {
+  (void)unused;
+  int more = 1;
+  while (1) {
+    editorLockBackground(more);
+    more = E.syntax && E.hlfrontier < E.numrows;
+    if (more) {
+      int to = E.hlfrontier + TVI_HL_BATCH;
+      editorLexTo((to < E.numrows ? to : E.numrows) - 1);
+      more = E.hlfrontier < E.numrows;
+      if (E.hlplain && E.hlfrontier >= syntaxShown())
+        editorEventWake();
+    }
+    editorUnlock();
+  }
+  return NULL;
+}
+
+static void syntaxStart() {
+  static int started = 0;
+  pthread_t tid;
+  if (started)
+    return;
+  // without a thread rows are lexed when they are shown, as
+  // they always were
+  if (pthread_create(&tid, NULL, syntaxWorker, NULL) == 0) {
+    pthread_detach(tid);
+    E.hlthread = 1;
+  }
+  started = 1;
+}
+
+// from the main loop when woken. returns 1 if rows drawn plain
+// are ready to be drawn again.
+int editorSyntaxPoll() { return E.hlplain && E.hlfrontier >= syntaxShown(); }
+
 int editorSyntaxToColor(int hl) {
   if (!E.highlighting)
     return 37;
@@ -404,6 +925,8 @@ int editorSyntaxToColor(int hl) {
     return 35;
   case HL_NUMBER:
     return 31;
+  case HL_OPERATOR:
+    return 33;
   case HL_MATCH:
     return 34;
   case HL_PUNCTUATION:
@@ -413,12 +936,9 @@ int editorSyntaxToColor(int hl) {
   }
 }
 
-void editorSelectSyntaxHighlight() {
-  E.syntax = NULL;
-  if (E.filename == NULL)
-    return;
-
-  char *ext = strrchr(E.filename, '.');
+// the syntax for a file name, NULL if there isn't one.
+struct editorSyntax *editorSyntaxFor(char *filename) {
+  char *ext = strrchr(filename, '.');
 
   for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
     struct editorSyntax *s = &HLDB[j];
@@ -426,16 +946,34 @@ void editorSelectSyntaxHighlight() {
     while (s->extensions[i]) {
       int is_ext = (s->extensions[i][0] == '.');
       if ((is_ext && ext && !strcmp(ext, s->extensions[i])) ||
-          (!is_ext && strstr(E.filename, s->extensions[i]))) {
-        E.syntax = s;
-        int filerow;
-        for (filerow = 0; filerow < E.numrows; filerow++) {
-          editorUpdateSyntax(&E.row[filerow]);
-        }
-        return;
-      }
+          (!is_ext && strstr(filename, s->extensions[i])))
+        return s;
       i++;
     }
   }
+  return NULL;
+}
+
+void editorSelectSyntaxHighlight() {
+  // every row has to be lexed again, which happens as they are
+  // shown.
+  E.syntax = NULL;
+  E.hlfrontier = 0;
+  E.hlresume = 0;
+  if (E.filename == NULL)
+    return;
+  syntaxStart();
+  E.syntax = editorSyntaxFor(E.filename);
+}
+
+// lex a row on its own for tvi -b syntax, with or without the
+// prescan, and return the comment state it ends in. E.syntax
+// has to be set. nothing else in the editor is touched.
+int editorSyntaxBench(erow *row, int in_comment, int prescan) {
+  int open_comment;
+  lexPrescan = prescan;
+  syntaxLex(row, 0, in_comment, row->rsize + 1, &open_comment);
+  lexPrescan = 1;
+  return open_comment;
 }
 
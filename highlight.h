@@ -31,7 +31,13 @@
 //       to the appropriate header
 extern void initializeKeywordTables();
 extern void editorSelectSyntaxHighlight();
+extern struct editorSyntax *editorSyntaxFor(char *);
 extern int editorSyntaxToColor(int);
 extern void editorUpdateSyntax(erow *row);
+extern void editorUpdateSyntaxSpan(erow *row, int, int, int);
+extern void editorScanSyntax(erow *row);
+extern void editorLexAhead(erow *row);
+extern int editorSyntaxPoll();
+extern int editorSyntaxBench(erow *, int, int);
 
 #endif // !FILE_HIGHLIGHT_H_SEEN
@@ -0,0 +1,177 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+#include "tvi.h"
+
+#include "lineindex.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// line offset index
+//
+// Finding the line breaks is most of the work of opening a big
+// file, so the buffer is cut into one chunk per worker thread.
+// Each worker compares 64 bytes at a time against '\n' with
+// SIMD and turns the matches into a bit mask, then walks the set
+// bits to record where the next line starts. The chunks' offsets
+// are stitched together in order at the end. Files too small to
+// be worth a thread are done on the calling thread alone.
+
+#define TVI_INDEX_CHUNK (8 << 20) // bytes a worker is worth
+#define TVI_INDEX_THREADS 16
+
+struct lineChunk {
+  const char *buf;
+  size_t lo; // scan buf[lo] up to buf[hi]
+  size_t hi;
+  size_t *off; // where each line after a newline starts
+  size_t n;
+  size_t cap;
+  int failed;
+};
+
+static void chunkPush(struct lineChunk *c, size_t at) {
+  if (c->n == c->cap) {
+    size_t cap = c->cap ? c->cap * 2 : 1024;
+    size_t *off = realloc(c->off, cap * sizeof(size_t));
+    if (off == NULL) {
+      c->failed = 1;
+      return;
+    }
+    c->off = off;
+    c->cap = cap;
+  }
+  c->off[c->n++] = at;
+}
+
+static void chunkPushMask(struct lineChunk *c, size_t at, uint64_t mask) {
+  while (mask) {
+    chunkPush(c, at + __builtin_ctzll(mask) + 1);
+    mask &= mask - 1;
+  }
+}
+
+static void *indexChunk(void *arg) {
+  struct lineChunk *c = arg;
+  const char *buf = c->buf;
+  size_t i = c->lo;
+
+#if defined(__AVX2__)
+  const __m256i nl = _mm256_set1_epi8('\n');
+  for (; i + 64 <= c->hi; i += 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+    chunkPushMask(c, i, lo | hi << 32);
+  }
+#elif defined(__SSE2__)
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; i + 64 <= c->hi; i += 64) {
+    uint64_t m0 = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), nl));
+    uint64_t m1 = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 16)), nl));
+    uint64_t m2 = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 32)), nl));
+    uint64_t m3 = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 48)), nl));
+    chunkPushMask(c, i, m0 | m1 << 16 | m2 << 32 | m3 << 48);
+  }
+#endif
+
+  for (; i < c->hi; i++)
+    if (buf[i] == '\n')
+      chunkPush(c, i + 1);
+  return NULL;
+}
+
+// how many workers editorIndexLines uses for a buffer of len
+int editorIndexThreads(size_t len) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = len / TVI_INDEX_CHUNK;
+  if (cpus > 0 && threads > (size_t)cpus)
+    threads = cpus;
+  if (threads > TVI_INDEX_THREADS)
+    threads = TVI_INDEX_THREADS;
+  return threads ? threads : 1;
+}
+
+// Returns the number of lines in buf and sets *offsets to an
+// array of that many plus one entries. Line i runs from
+// offsets[i] up to offsets[i + 1], newline included. A last
+// line without a newline still counts, as getline would see it.
+// The caller frees *offsets.
+long editorIndexLines(const char *buf, size_t len, size_t **offsets) {
+  struct lineChunk chunks[TVI_INDEX_THREADS];
+  pthread_t tids[TVI_INDEX_THREADS];
+  int started[TVI_INDEX_THREADS];
+  int threads = editorIndexThreads(len);
+  int k;
+
+  memset(chunks, 0, sizeof(chunks));
+  for (k = 0; k < threads; k++) {
+    chunks[k].buf = buf;
+    chunks[k].lo = len / threads * k;
+    chunks[k].hi = (k == threads - 1) ? len : len / threads * (k + 1);
+  }
+  // the first chunk runs here, a worker that won't start runs
+  // here as well.
+  for (k = 1; k < threads; k++) {
+    started[k] = pthread_create(&tids[k], NULL, indexChunk, &chunks[k]) == 0;
+    if (!started[k])
+      indexChunk(&chunks[k]);
+  }
+  indexChunk(&chunks[0]);
+
+  size_t total = 0;
+  for (k = 0; k < threads; k++) {
+    if (k > 0 && started[k])
+      pthread_join(tids[k], NULL);
+    if (chunks[k].failed)
+      die("editorIndexLines-realloc");
+    total += chunks[k].n;
+  }
+
+  size_t *off = malloc((total + 2) * sizeof(size_t));
+  if (off == NULL)
+    die("editorIndexLines-malloc");
+  long n = 0;
+  off[0] = 0;
+  for (k = 0; k < threads; k++) {
+    if (chunks[k].n)
+      memcpy(&off[n + 1], chunks[k].off, chunks[k].n * sizeof(size_t));
+    n += chunks[k].n;
+    free(chunks[k].off);
+  }
+  if (off[n] < len)
+    off[++n] = len;
+
+  *offsets = off;
+  return n;
+}
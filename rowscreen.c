@@ -22,20 +22,171 @@
 //
 
 #include "tvi.h"
+#include "arena.h"
 #include "highlight.h"
 
 #include "rowscreen.h"
+#include "rowstore.h"
+#include "save.h"
+
+/////////////////////////////////////////////////////////////
+// row text is a gap buffer
+//
+// chars holds size characters with a gap of gaplen unused
+// bytes parked at offset gap. typing at the cursor fills the
+// gap, so a run of inserts only moves text when the cursor
+// jumps or the gap runs out. with the gap moved to the end
+// the text is contiguous again, see editorRowChars.
+//
+// A row loaded from a mapped file (ROW_MAPPED) points straight
+// into the mapping. It gets its own copy in the row arena the
+// first time it is edited, see rowMakeWritable. Whatever slack
+// the arena's size class leaves becomes gap, so a row's block
+// is always size + gaplen + 1 bytes.
+//
+// The same goes for a row whose chars a background save is still
+// writing out. It is copied before it changes, and the old block
+// is freed once the save is done, see save.c.
+
+static void rowUnshare(erow *row);
+
+static void rowMakeWritable(erow *row) {
+  rowUnshare(row);
+  int saving = E.savegen && row->savegen == E.savegen;
+  if (!(row->flags & ROW_MAPPED) && !saving)
+    return;
+  size_t cap = arenaRound(row->size + TVI_ROW_GAP + 1);
+  char *chars = arenaAlloc(cap);
+  memcpy(chars, row->chars, row->gap);
+  memcpy(&chars[row->gap], &row->chars[row->gap + row->gaplen],
+         row->size - row->gap);
+  if (!(row->flags & ROW_MAPPED))
+    editorSaveDeferFree(row->chars, row->size + row->gaplen + 1);
+  row->chars = chars;
+  row->gap = row->size;
+  row->gaplen = cap - row->size - 1;
+  row->flags &= ~ROW_MAPPED;
+  row->savegen = 0;
+}
+
+static void rowMoveGap(erow *row, int at) {
+  if (at < row->gap)
+    memmove(&row->chars[at + row->gaplen], &row->chars[at], row->gap - at);
+  else if (at > row->gap)
+    memmove(&row->chars[row->gap], &row->chars[row->gap + row->gaplen],
+            at - row->gap);
+  row->gap = at;
+}
+
+// park the gap at at with room for at least len characters.
+static void rowOpenGap(erow *row, int at, int len) {
+  rowMakeWritable(row);
+  if (row->gaplen < len) {
+    int gaplen = row->size + len;
+    if (gaplen < TVI_ROW_GAP)
+      gaplen = TVI_ROW_GAP;
+    size_t cap = arenaRound(row->size + gaplen + 1);
+    rowMoveGap(row, row->size);
+    row->chars =
+        arenaRealloc(row->chars, row->size + row->gaplen + 1, cap);
+    row->gaplen = cap - row->size - 1;
+  }
+  rowMoveGap(row, at);
+}
+
+static void rowInsertChars(erow *row, int at, const char *s, int len) {
+  rowOpenGap(row, at, len);
+  memcpy(&row->chars[row->gap], s, len);
+  row->gap += len;
+  row->gaplen -= len;
+  row->size += len;
+}
+
+static void rowDeleteChar(erow *row, int at) {
+  rowMakeWritable(row);
+  rowMoveGap(row, at + 1);
+  row->gap--;
+  row->gaplen++;
+  row->size--;
+}
+
+// drop everything from at to the end of the row.
+static void rowTruncate(erow *row, int at) {
+  rowMakeWritable(row);
+  rowMoveGap(row, row->size);
+  row->gap = at;
+  row->gaplen += row->size - at;
+  row->size = at;
+}
+
+// close the gap and return the row's size characters in one
+// piece. they are not '\0' terminated.
+char *editorRowChars(erow *row) {
+  if (row->gap < row->size)
+    rowMakeWritable(row);
+  rowMoveGap(row, row->size);
+  return row->chars;
+}
 
 /////////////////////////////////////////////////////////////
 // row of screen and in buffer mapping
 //
 // TODO: should the actual display be segregated?
 
+// A rendered row with tabs keeps where each tab is in chars and
+// the render column just after it, so a column only has to be
+// looked up against the tabs before it. The index is built with
+// render by rowRenderFrom and lives with the row's slot in the
+// render ring, so rows that aren't rendered cost nothing. Those
+// still walk the row. A row without tabs maps one to one.
+
+struct rowTab {
+  int cx; // where the tab is in chars
+  int rx; // the render column after it
+};
+
+struct rowTabs {
+  struct rowTab *tab;
+  int n; // tabs indexed for the row in the slot
+  int cap;
+};
+
+static struct rowTabs *rowTabIndex; // one per E.rowcache slot
+
+// the row's tab index, NULL if it doesn't have one.
+static struct rowTabs *rowTabsOf(erow *row) {
+  if (row->tabs <= 0 || row->cacheslot < 0)
+    return NULL;
+  return &rowTabIndex[row->cacheslot];
+}
+
+// how many of the indexed tabs come before chars column cx.
+static int rowTabsBefore(struct rowTabs *t, int cx) {
+  int lo = 0, hi = t->n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (t->tab[mid].cx < cx)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 int editorRowCxToRx(erow *row, int cx) {
+  if (row->tabs == 0)
+    return cx;
+  struct rowTabs *t = rowTabsOf(row);
+  if (t) {
+    int k = rowTabsBefore(t, cx);
+    if (k == 0)
+      return cx;
+    return t->tab[k - 1].rx + cx - t->tab[k - 1].cx - 1;
+  }
   int rx = 0;
   int j;
   for (j = 0; j < cx; j++) {
-    if (row->chars[j] == '\t')
+    if (ROW_CHAR(row, j) == '\t')
       rx += (TVI_TAB_STOP - 1) - (rx % TVI_TAB_STOP);
     rx++;
   }
@@ -43,10 +194,31 @@ int editorRowCxToRx(erow *row, int cx) {
 }
 
 int editorRowRxToCx(erow *row, int rx) {
+  if (row->tabs == 0)
+    return rx < row->size ? rx : row->size;
+  struct rowTabs *t = rowTabsOf(row);
+  if (t) {
+    // the first tab that ends past rx, and where the chars
+    // between it and the one before start
+    int lo = 0, hi = t->n;
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (t->tab[mid].rx <= rx)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    int cx = lo ? t->tab[lo - 1].cx + 1 : 0;
+    int base = lo ? t->tab[lo - 1].rx : 0;
+    if (lo < t->n && rx >= base + t->tab[lo].cx - cx)
+      return t->tab[lo].cx;
+    cx += rx - base;
+    return cx < row->size ? cx : row->size;
+  }
   int cur_rx = 0;
   int cx;
   for (cx = 0; cx < row->size; cx++) {
-    if (row->chars[cx] == '\t')
+    if (ROW_CHAR(row, cx) == '\t')
       cur_rx += (TVI_TAB_STOP - 1) - (cur_rx % TVI_TAB_STOP);
     cur_rx++;
     if (cur_rx > rx)
@@ -55,91 +227,368 @@ int editorRowRxToCx(erow *row, int rx) {
   return cx;
 }
 
-void editorUpdateRow(erow *row) {
+/////////////////////////////////////////////////////////////
+// render and hl are built on demand
+//
+// Nothing but chars is filled in when a row is inserted. render
+// and hl are built the first time a row is drawn or searched,
+// see editorPrepareRow, and a row that has them sits in a small
+// ring. When the ring is full the oldest row gives them up
+// again, so their memory tracks the screen and not the file.
+//
+// A row without tabs renders to exactly its chars, so render
+// just points at them (ROW_SHARED) and only hl gets a block of
+// its own. Such a render is not '\0' terminated. The row gets a
+// copy of its own back before its chars change, see
+// rowMakeWritable, so typing works on render as it always did.
+
+static void rowEvict(erow *row) {
+  if (!(row->flags & ROW_SHARED))
+    arenaFree(row->render, row->rcap);
+  arenaFree(row->hl, row->rcap);
+  row->render = NULL;
+  row->hl = NULL;
+  row->rsize = 0;
+  row->rcap = 0;
+  row->flags &= ~ROW_SHARED;
+  row->cacheslot = -1;
+}
+
+static void rowCache(erow *row) {
+  if (E.rowcache == NULL) {
+    E.rowcachesize = E.screenrows * 4;
+    if (E.rowcachesize < TVI_ROW_CACHE)
+      E.rowcachesize = TVI_ROW_CACHE;
+    E.rowcache = calloc(E.rowcachesize, sizeof(erow *));
+    rowTabIndex = calloc(E.rowcachesize, sizeof(struct rowTabs));
+    if (E.rowcache == NULL || rowTabIndex == NULL)
+      die("rowCache-calloc");
+  }
+  erow *old = E.rowcache[E.rowcachenext];
+  if (old)
+    rowEvict(old);
+  E.rowcache[E.rowcachenext] = row;
+  rowTabIndex[E.rowcachenext].n = 0;
+  row->cacheslot = E.rowcachenext;
+  E.rowcachenext = (E.rowcachenext + 1) % E.rowcachesize;
+}
+
+// render and hl share one capacity and grow together.
+static void rowReserveRender(erow *row, int need) {
+  if (need <= row->rcap)
+    return;
+  if (row->hl == NULL)
+    rowCache(row);
+  int rcap = row->rcap * 2;
+  if (rcap < need)
+    rcap = need;
+  rcap = arenaRound(rcap);
+  if (!(row->flags & ROW_SHARED))
+    row->render = arenaRealloc(row->render, row->rcap, rcap);
+  row->hl = arenaRealloc(row->hl, row->rcap, rcap);
+  row->rcap = rcap;
+}
+
+// give a row that renders from its chars a render of its own.
+// shared rows keep room for the '\0' in rcap.
+static void rowUnshare(erow *row) {
+  if (!(row->flags & ROW_SHARED))
+    return;
+  char *render = arenaAlloc(row->rcap);
+  memcpy(render, row->render, row->rsize);
+  render[row->rsize] = '\0';
+  row->render = render;
+  row->flags &= ~ROW_SHARED;
+}
+
+// expand tabs from character cx, which lands on render column
+// rx, through the end of the row, and index them. the tabs before
+// cx are indexed already.
+static void rowRenderFrom(erow *row, int cx, int rx) {
   int tabs = 0;
   int j;
-  for (j = 0; j < row->size; j++)
-    if (row->chars[j] == '\t')
+  for (j = cx; j < row->size; j++)
+    if (ROW_CHAR(row, j) == '\t')
       tabs++;
+  rowReserveRender(row, rx + row->size - cx + tabs * (TVI_TAB_STOP - 1) + 1);
 
-  free(row->render);
-  row->render = malloc(row->size + tabs * (TVI_TAB_STOP - 1) + 1);
+  struct rowTabs *t = &rowTabIndex[row->cacheslot];
+  t->n = rowTabsBefore(t, cx);
+  if (t->n + tabs > t->cap) {
+    int cap = t->n + tabs > t->cap * 2 ? t->n + tabs : t->cap * 2;
+    t->tab = realloc(t->tab, cap * sizeof(struct rowTab));
+    if (t->tab == NULL)
+      die("rowRenderFrom-realloc");
+    t->cap = cap;
+  }
 
-  int idx = 0;
-  for (j = 0; j < row->size; j++) {
-    if (row->chars[j] == '\t') {
-      row->render[idx++] = ' ';
-      while (idx % TVI_TAB_STOP != 0)
-        row->render[idx++] = ' ';
+  for (j = cx; j < row->size; j++) {
+    char c = ROW_CHAR(row, j);
+    if (c == '\t') {
+      row->render[rx++] = ' ';
+      while (rx % TVI_TAB_STOP != 0)
+        row->render[rx++] = ' ';
+      t->tab[t->n].cx = j;
+      t->tab[t->n].rx = rx;
+      t->n++;
     } else {
-      row->render[idx++] = row->chars[j];
+      row->render[rx++] = c;
     }
   }
-  row->render[idx] = '\0';
-  row->rsize = idx;
+  row->render[rx] = '\0';
+  row->rsize = rx;
+}
+
+void editorRenderRow(erow *row) {
+  int tabs = 0;
+  int j;
+  for (j = 0; j < row->size; j++)
+    if (ROW_CHAR(row, j) == '\t')
+      tabs++;
+  row->tabs = tabs;
+
+  if (tabs) {
+    rowUnshare(row);
+    rowRenderFrom(row, 0, 0);
+    return;
+  }
+  char *chars = editorRowChars(row);
+  if (!(row->flags & ROW_SHARED)) {
+    arenaFree(row->render, row->rcap);
+    row->flags |= ROW_SHARED;
+  }
+  rowReserveRender(row, row->size + 1);
+  row->render = chars;
+  row->rsize = row->size;
+  rowTabIndex[row->cacheslot].n = 0;
+}
 
+void editorUpdateRow(erow *row) {
+  editorRenderRow(row);
   editorUpdateSyntax(row);
 }
 
+// Move the frontier past row at.
+//
+// Rows before E.hlfrontier know the block comment state they
+// end in. Anything past it has to be lexed in order first, as
+// the state coming into a row depends on every row above it.
+//
+// Rows on the way only need the state they end in, so they are
+// just scanned for it. A row that has render, because it is on
+// the screen or was, has its hl brought up to date as well. There
+// are no checkpoints ahead of the frontier. The first jump to a
+// row past it still scans every row in between, so it costs the
+// distance jumped, only cheaper per row. A row keeps its state
+// once it has one, so after that every row before the frontier
+// acts as a checkpoint and a jump back into that part of the file
+// only lexes the rows shown.
+//
+// When an edit pulled the frontier back, the rows up to
+// E.hlresume were lexed before it and only their comment state
+// coming in is in doubt. Once one of them comes out of the lexer
+// the same as it did before, the rows after it are right as they
+// are and the frontier can jump ahead.
+void editorLexTo(int at) {
+  erow *r = at < E.hlfrontier ? NULL : editorRowAt(E.hlfrontier);
+  while (E.hlfrontier <= at) {
+    int was = r->hl_open_comment;
+    if (r->render) {
+      editorUpdateSyntax(r);
+    } else {
+      editorScanSyntax(r);
+    }
+    E.hlfrontier++;
+    if (E.hlfrontier < E.hlresume && r->hl_open_comment == was) {
+      E.hlfrontier = E.hlresume;
+      E.hlresume = 0;
+      r = editorRowAt(E.hlfrontier);
+    } else {
+      r = editorRowNext(r);
+    }
+  }
+}
+
+// Hand back row at with render and hl ready to use.
+erow *editorPrepareRow(int at) {
+  erow *row = editorRowAt(at);
+  if (row == NULL)
+    return NULL;
+
+  editorLexTo(at);
+  if (row->render == NULL)
+    editorUpdateRow(row);
+  return row;
+}
+
+// the same for a row that is only being drawn. one past the
+// frontier isn't lexed in order first, that would keep the screen
+// waiting, so its hl can't be trusted until the frontier gets
+// there, see editorLexTo.
+erow *editorShowRow(int at) {
+  if (at < E.hlfrontier || !E.hlthread)
+    return editorPrepareRow(at);
+  erow *row = editorRowAt(at);
+  if (row && row->render == NULL) {
+    editorRenderRow(row);
+    editorLexAhead(row);
+  }
+  return row;
+}
+
+// set up a freshly stored row that still points into the mapped
+// file. nothing is copied until the row is edited.
+void editorMapRow(erow *row, char *s, size_t len) {
+  row->size = len;
+  row->chars = s;
+  row->gap = len;
+  row->gaplen = 0;
+  row->tabs = -1;
+  row->flags = ROW_MAPPED;
+  row->cacheslot = -1;
+}
+
+// give a freshly stored row its own copy of s.
+static void rowFill(erow *row, const char *s, size_t len) {
+  size_t cap = arenaRound(len + 1);
+  row->size = len;
+  row->chars = arenaAlloc(cap);
+  memcpy(row->chars, s, len);
+  row->chars[len] = '\0';
+  row->gap = len;
+  row->gaplen = cap - len - 1;
+  row->tabs = -1;
+  row->flags = 0;
+
+  row->rsize = 0;
+  row->rcap = 0;
+  row->render = NULL;
+  row->hl = NULL;
+  row->hl_open_comment = 0;
+  row->cacheslot = -1;
+}
+
 void editorInsertRow(int at, char *s, size_t len) {
   if (at < 0 || at > E.numrows)
     return;
 
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at));
-  for (int j = at + 1; j <= E.numrows; j++)
-    E.row[j].idx++;
-
-  E.row[at].idx = at;
+  erow *row = editorRowStoreInsert(at);
+  rowFill(row, s, len);
 
-  E.row[at].size = len;
-  E.row[at].chars = malloc(len + 1);
-  memcpy(E.row[at].chars, s, len);
-  E.row[at].chars[len] = '\0';
-
-  E.row[at].rsize = 0;
-  E.row[at].render = NULL;
-  E.row[at].hl = NULL;
-  E.row[at].hl_open_comment = 0;
-  editorUpdateRow(&E.row[at]);
+  // a row landing inside the lexed part of the file has to be
+  // lexed now to keep it that way. anything else waits until
+  // it is shown. the row below was lexed with the state the row
+  // above ends in, start from that so a change is noticed.
+  if (at < E.hlfrontier) {
+    erow *prev = editorRowPrev(row);
+    row->hl_open_comment = prev && prev->hl_open_comment;
+    E.hlfrontier++;
+    if (E.hlresume)
+      E.hlresume++;
+    editorUpdateRow(row);
+  } else if (at < E.hlresume) {
+    // a new row was never lexed, so it can't vouch for the
+    // rows after it
+    E.hlresume = 0;
+  }
 
-  E.numrows++;
   E.dirty++;
 }
 
 void editorFreeRow(erow *row) {
-  free(row->render);
-  free(row->chars);
-  free(row->hl);
+  if (row->cacheslot >= 0)
+    E.rowcache[row->cacheslot] = NULL;
+  if (!(row->flags & ROW_SHARED))
+    arenaFree(row->render, row->rcap);
+  if (E.savegen && row->savegen == E.savegen)
+    editorSaveDeferFree(row->chars, row->size + row->gaplen + 1);
+  else if (!(row->flags & ROW_MAPPED))
+    arenaFree(row->chars, row->size + row->gaplen + 1);
+  arenaFree(row->hl, row->rcap);
+}
+
+// drop every row when the buffer is closed. the rows all live
+// in the arena, so there is nothing to walk.
+void editorFreeRows() {
+  if (E.rowcache)
+    memset(E.rowcache, 0, E.rowcachesize * sizeof(erow *));
+  E.rowcachenext = 0;
+  E.hlfrontier = 0;
+  E.hlresume = 0;
+  editorRowStoreClear();
+  arenaRelease();
 }
 
-void editorDelRow(int at) {
-  if (at < 0 || at >= E.numrows)
+// delete count rows starting at at. the rows are freed one by
+// one but come out of the store in a single cut.
+void editorDelRows(int at, int count) {
+  if (at < 0 || at >= E.numrows || count <= 0)
     return;
-  editorFreeRow(&E.row[at]);
-  memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-  for (int j = at; j < E.numrows - 1; j++)
-    E.row[j].idx--;
-  E.numrows--;
-  E.dirty++;
+  if (count > E.numrows - at)
+    count = E.numrows - at;
+  erow *row = editorRowAt(at);
+  erow *prev = editorRowPrev(row);
+  int open_comment = 0;
+  int j;
+  for (j = 0; j < count; j++) {
+    erow *next = editorRowNext(row);
+    open_comment = row->hl_open_comment;
+    editorFreeRow(row);
+    row = next;
+  }
+  editorRowStoreDeleteRun(at, count);
+  // rows that were lexed in their old state can only vouch for
+  // the rows after them up to the cut, which joins rows that
+  // weren't lexed together
+  if (at > E.hlfrontier && at < E.hlresume)
+    E.hlresume = at;
+  else if (at < E.hlresume)
+    E.hlresume -= E.hlresume - at < count ? E.hlresume - at : count;
+  if (at < E.hlfrontier) {
+    E.hlfrontier -= E.hlfrontier - at < count ? E.hlfrontier - at : count;
+    // the row that moved up now follows a different row
+    if (row && at < E.hlfrontier &&
+        (prev && prev->hl_open_comment) != open_comment) {
+      if (row->render == NULL)
+        editorRenderRow(row);
+      editorUpdateSyntax(row);
+    }
+  }
+  E.dirty += count;
 }
 
+void editorDelRow(int at) { editorDelRows(at, 1); }
+
+// The row editing functions expect a prepared row.
+//
+// typing only changes render from the cursor on. a row without
+// tabs just shifts its tail, a row with tabs re-expands the tail
+// since the tab widths after the cursor can change. either way
+// only that span gets highlighted again.
 void editorRowInsertChar(erow *row, int at, int c) {
   if (at < 0 || at > row->size)
     at = row->size;
-  row->chars = realloc(row->chars, row->size + 2);
-  memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-  row->size++;
-  row->chars[at] = c;
-  editorUpdateRow(row);
+  int rx = editorRowCxToRx(row, at);
+  int oldrsize = row->rsize;
+  char ch = c;
+  rowInsertChars(row, at, &ch, 1);
+  if (ch == '\t')
+    row->tabs++;
+
+  if (row->tabs == 0) {
+    rowReserveRender(row, row->rsize + 2);
+    memmove(&row->render[rx + 1], &row->render[rx], row->rsize - rx + 1);
+    row->render[rx] = ch;
+    row->rsize++;
+  } else {
+    rowRenderFrom(row, at, rx);
+  }
+  editorUpdateSyntaxSpan(row, rx, oldrsize - rx, row->rsize - rx);
   E.dirty++;
 }
 
 void editorRowAppendString(erow *row, char *s, size_t len) {
-  row->chars = realloc(row->chars, row->size + len + 1);
-  memcpy(&row->chars[row->size], s, len);
-  row->size += len;
-  row->chars[row->size] = '\0';
+  rowInsertChars(row, row->size, s, len);
   editorUpdateRow(row);
   E.dirty++;
 }
@@ -147,9 +596,20 @@ void editorRowAppendString(erow *row, char *s, size_t len) {
 void editorRowDelChar(erow *row, int at) {
   if (at < 0 || at >= row->size)
     return;
-  memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-  row->size--;
-  editorUpdateRow(row);
+  int rx = editorRowCxToRx(row, at);
+  int oldrsize = row->rsize;
+  char ch = ROW_CHAR(row, at);
+  rowDeleteChar(row, at);
+  if (ch == '\t')
+    row->tabs--;
+
+  if (ch != '\t' && row->tabs == 0) {
+    memmove(&row->render[rx], &row->render[rx + 1], row->rsize - rx);
+    row->rsize--;
+  } else {
+    rowRenderFrom(row, at, rx);
+  }
+  editorUpdateSyntaxSpan(row, rx, oldrsize - rx, row->rsize - rx);
   E.dirty++;
 }
 
@@ -160,7 +620,7 @@ void editorInsertChar(int c) {
   if (E.cy == E.numrows) {
     editorInsertRow(E.numrows, "", 0);
   }
-  editorRowInsertChar(&E.row[E.cy], E.cx, c);
+  editorRowInsertChar(editorPrepareRow(E.cy), E.cx, c);
   E.cx++;
 }
 
@@ -168,29 +628,108 @@ void editorInsertNewLine() {
   if (E.cx == 0) {
     editorInsertRow(E.cy, "", 0);
   } else {
-    erow *row = &E.row[E.cy];
-    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-    row = &E.row[E.cy]; // note: prior call could have done a realloc
-    row->size = E.cx;
-    row->chars[row->size] = '\0';
+    erow *row = editorPrepareRow(E.cy);
+    char *chars = editorRowChars(row);
+    editorInsertRow(E.cy + 1, &chars[E.cx], row->size - E.cx);
+    rowTruncate(row, E.cx);
     editorUpdateRow(row);
   }
   E.cy++;
   E.cx = 0;
 }
 
+// length of the line at the start of s, and in *next where the
+// line after it starts, or len if it is the last one.
+static size_t lineLength(const char *s, size_t len, size_t *next) {
+  size_t n = 0;
+  while (n < len && s[n] != '\r' && s[n] != '\n')
+    n++;
+  *next = n;
+  if (n < len)
+    *next += (s[n] == '\r' && n + 1 < len && s[n + 1] == '\n') ? 2 : 1;
+  return n;
+}
+
+// Insert text at the cursor as one edit, as for a paste, and
+// leave the cursor after it. Line breaks may be \r, \n or \r\n.
+//
+// The first line joins the cursor row, the rest go into the row
+// store as a single run of new rows, and the last one picks up
+// whatever followed the cursor. Then the rows are lexed in one
+// pass. If the comment state coming out of the paste is what it
+// was before, the rows below were lexed right and stay that way.
+void editorInsertText(const char *s, size_t len) {
+  if (E.cy == E.numrows)
+    editorInsertRow(E.numrows, "", 0);
+  erow *row = editorPrepareRow(E.cy);
+
+  int lines = 0; // line breaks in the text
+  size_t at, next, n;
+  for (at = 0; at < len; at = next) {
+    n = lineLength(&s[at], len - at, &next);
+    next += at;
+    if (at + n < len)
+      lines++;
+  }
+
+  int frontier = E.hlfrontier;
+  int open_comment = row->hl_open_comment;
+  E.hlresume = 0;
+
+  n = lineLength(s, len, &next);
+  if (lines == 0) {
+    rowInsertChars(row, E.cx, s, n);
+    E.cx += n;
+  } else {
+    // move what follows the cursor to the end of the last line
+    int taillen = row->size - E.cx;
+    char *tail = malloc(taillen + 1);
+    if (tail == NULL)
+      die("editorInsertText-malloc");
+    memcpy(tail, &editorRowChars(row)[E.cx], taillen);
+    rowTruncate(row, E.cx);
+    rowInsertChars(row, E.cx, s, n);
+
+    erow *r = editorRowStoreInsertRun(E.cy + 1, lines);
+    int j;
+    for (j = 0; j < lines; j++) {
+      at = next;
+      n = lineLength(&s[at], len - at, &next);
+      next += at;
+      rowFill(r, &s[at], n);
+      if (j == lines - 1) {
+        rowInsertChars(r, n, tail, taillen);
+        E.cx = n;
+      }
+      r = editorRowNext(r);
+    }
+    free(tail);
+    E.cy += lines;
+  }
+  editorRenderRow(row);
+
+  if (E.cy - lines < frontier) {
+    E.hlfrontier = E.cy - lines;
+    editorPrepareRow(E.cy);
+    if (editorRowAt(E.cy)->hl_open_comment == open_comment)
+      E.hlfrontier = frontier + lines;
+  }
+  E.dirty++;
+}
+
 void editorDelChar() {
   if (E.cy == E.numrows)
     return;
   if (E.cx == 0 && E.cy == 0)
     return;
-  erow *row = &E.row[E.cy];
+  erow *row = editorPrepareRow(E.cy);
   if (E.cx > 0) {
     editorRowDelChar(row, E.cx - 1);
     E.cx--;
   } else {
-    E.cx = E.row[E.cy - 1].size;
-    editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
+    erow *prev = editorPrepareRow(E.cy - 1);
+    E.cx = prev->size;
+    editorRowAppendString(prev, editorRowChars(row), row->size);
     editorDelRow(E.cy);
     E.cy--;
   }
@@ -32,7 +32,16 @@
 extern void editorInsertChar(int);
 extern void editorDelChar();
 extern void editorInsertNewLine();
+extern void editorInsertText(const char *, size_t);
 extern void editorInsertRow(int, char *, size_t);
+extern void editorDelRows(int, int);
+extern void editorMapRow(erow *, char *, size_t);
+extern void editorFreeRows();
+extern char *editorRowChars(erow *);
+extern void editorRenderRow(erow *);
+extern erow *editorPrepareRow(int);
+extern erow *editorShowRow(int);
+extern void editorLexTo(int);
 extern int editorRowCxToRx(erow *, int);
 extern int editorRowRxToCx(erow *, int);
 
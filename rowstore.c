@@ -0,0 +1,281 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+#include "tvi.h"
+
+#include "arena.h"
+#include "rowstore.h"
+
+/////////////////////////////////////////////////////////////
+// line store
+//
+// The rows used to be one big array, so every line insert or
+// delete moved the whole tail and renumbered it. Now each row
+// is a node in a treap (a binary tree kept balanced by random
+// priorities) where every node knows how many rows are in its
+// subtree. Line number lookups walk down by those counts, and
+// splitting or joining at a line number touches O(log n) nodes.
+//
+// The erow is the first member of the node, so an erow pointer
+// handed out by the store can be turned back into its node. The
+// parent links let editorRowNext/Prev and editorRowIndex work
+// from a row without knowing its line number. Nodes come from
+// the row arena, see arena.c.
+
+struct rownode {
+  erow row; // must be first
+  struct rownode *left;
+  struct rownode *right;
+  struct rownode *parent;
+  int count; // rows in this subtree, including this one
+  unsigned int prio;
+};
+
+// the tree only needs cheap, decent random priorities
+static unsigned int rowPrio() {
+  static unsigned int seed = 2463534242u;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static struct rownode *nodeAlloc() {
+  struct rownode *n = arenaAlloc(sizeof(struct rownode));
+  memset(n, 0, sizeof(struct rownode));
+  return n;
+}
+
+static int nodeCount(struct rownode *n) { return n ? n->count : 0; }
+
+// recount a node after its children change and point the
+// children back at it.
+static void nodeUpdate(struct rownode *n) {
+  n->count = 1 + nodeCount(n->left) + nodeCount(n->right);
+  if (n->left)
+    n->left->parent = n;
+  if (n->right)
+    n->right->parent = n;
+}
+
+// split t so the first k rows end up in *a and the rest in *b.
+static void nodeSplit(struct rownode *t, int k, struct rownode **a,
+                      struct rownode **b) {
+  if (t == NULL) {
+    *a = *b = NULL;
+    return;
+  }
+  if (nodeCount(t->left) >= k) {
+    nodeSplit(t->left, k, a, &t->left);
+    nodeUpdate(t);
+    *b = t;
+  } else {
+    nodeSplit(t->right, k - nodeCount(t->left) - 1, &t->right, b);
+    nodeUpdate(t);
+    *a = t;
+  }
+}
+
+// join two trees, every row of a comes before every row of b.
+static struct rownode *nodeMerge(struct rownode *a, struct rownode *b) {
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (a->prio > b->prio) {
+    a->right = nodeMerge(a->right, b);
+    nodeUpdate(a);
+    return a;
+  }
+  b->left = nodeMerge(a, b->left);
+  nodeUpdate(b);
+  return b;
+}
+
+static void setRoot(struct rownode *t) {
+  if (t)
+    t->parent = NULL;
+  E.rowtree = t;
+  E.numrows = nodeCount(t);
+}
+
+/////////////////////////////////////////////////////////////
+// lookup and traversal
+
+erow *editorRowAt(int at) {
+  if (at < 0 || at >= E.numrows)
+    return NULL;
+  struct rownode *n = E.rowtree;
+  while (n) {
+    int left = nodeCount(n->left);
+    if (at < left) {
+      n = n->left;
+    } else if (at == left) {
+      return &n->row;
+    } else {
+      at -= left + 1;
+      n = n->right;
+    }
+  }
+  return NULL;
+}
+
+erow *editorRowNext(erow *row) {
+  struct rownode *n = (struct rownode *)row;
+  if (n->right) {
+    n = n->right;
+    while (n->left)
+      n = n->left;
+    return &n->row;
+  }
+  while (n->parent && n->parent->right == n)
+    n = n->parent;
+  return n->parent ? &n->parent->row : NULL;
+}
+
+erow *editorRowPrev(erow *row) {
+  struct rownode *n = (struct rownode *)row;
+  if (n->left) {
+    n = n->left;
+    while (n->right)
+      n = n->right;
+    return &n->row;
+  }
+  while (n->parent && n->parent->left == n)
+    n = n->parent;
+  return n->parent ? &n->parent->row : NULL;
+}
+
+int editorRowIndex(erow *row) {
+  struct rownode *n = (struct rownode *)row;
+  int at = nodeCount(n->left);
+  while (n->parent) {
+    if (n->parent->right == n)
+      at += nodeCount(n->parent->left) + 1;
+    n = n->parent;
+  }
+  return at;
+}
+
+/////////////////////////////////////////////////////////////
+// insert and delete
+
+// add an empty row at line number at and return it. the caller
+// fills in the row contents.
+erow *editorRowStoreInsert(int at) {
+  if (at < 0 || at > E.numrows)
+    return NULL;
+
+  struct rownode *n = nodeAlloc();
+  n->count = 1;
+  n->prio = rowPrio();
+
+  struct rownode *a, *b;
+  nodeSplit(E.rowtree, at, &a, &b);
+  setRoot(nodeMerge(nodeMerge(a, n), b));
+  return &n->row;
+}
+
+// build a balanced tree out of nodes[lo] through nodes[hi - 1].
+// a parent always sits higher than its children, so giving it a
+// priority from its height keeps the heap order a treap needs.
+static struct rownode *nodeBuild(struct rownode **nodes, int lo, int hi,
+                                 int *height) {
+  if (lo >= hi) {
+    *height = 0;
+    return NULL;
+  }
+  int mid = lo + (hi - lo) / 2;
+  int lh, rh;
+  struct rownode *n = nodes[mid];
+  n->left = nodeBuild(nodes, lo, mid, &lh);
+  n->right = nodeBuild(nodes, mid + 1, hi, &rh);
+  *height = 1 + (lh > rh ? lh : rh);
+  n->prio = ((unsigned int)*height << 24) | (rowPrio() & 0xffffff);
+  nodeUpdate(n);
+  return n;
+}
+
+// add count empty rows starting at line number at in one go, as
+// when a file is loaded or text is pasted, and return the first
+// of them. the rest follow it in editorRowNext order.
+erow *editorRowStoreInsertRun(int at, int count) {
+  if (count <= 0 || at < 0 || at > E.numrows)
+    return NULL;
+
+  struct rownode **nodes = malloc(count * sizeof(struct rownode *));
+  if (nodes == NULL)
+    die("editorRowStoreInsertRun-malloc");
+  int j;
+  for (j = 0; j < count; j++)
+    nodes[j] = nodeAlloc();
+
+  int height;
+  struct rownode *first = nodes[0];
+  struct rownode *t = nodeBuild(nodes, 0, count, &height);
+  free(nodes);
+  struct rownode *a, *b;
+  nodeSplit(E.rowtree, at, &a, &b);
+  setRoot(nodeMerge(nodeMerge(a, t), b));
+  return &first->row;
+}
+
+// unlink row at and release its node. the caller is expected
+// to have freed the row contents first.
+void editorRowStoreDelete(int at) {
+  if (at < 0 || at >= E.numrows)
+    return;
+
+  struct rownode *a, *b, *c;
+  nodeSplit(E.rowtree, at, &a, &b);
+  nodeSplit(b, 1, &b, &c);
+  arenaFree(b, sizeof(struct rownode));
+  setRoot(nodeMerge(a, c));
+}
+
+// hand a subtree's nodes back to the arena.
+static void nodeFreeTree(struct rownode *t) {
+  if (t == NULL)
+    return;
+  nodeFreeTree(t->left);
+  nodeFreeTree(t->right);
+  arenaFree(t, sizeof(struct rownode));
+}
+
+// unlink count rows starting at at in one go, as for 3dd. the
+// tree work is one cut on each side no matter how many rows go.
+// the caller is expected to have freed the row contents first.
+void editorRowStoreDeleteRun(int at, int count) {
+  if (at < 0 || at >= E.numrows || count <= 0)
+    return;
+
+  struct rownode *a, *b, *c;
+  nodeSplit(E.rowtree, at, &a, &b);
+  nodeSplit(b, count, &b, &c);
+  nodeFreeTree(b);
+  setRoot(nodeMerge(a, c));
+}
+
+// forget every row at once. the nodes and row contents are
+// given back by arenaRelease.
+void editorRowStoreClear() { setRoot(NULL); }
@@ -0,0 +1,42 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+// clang-format on
+
+#ifndef FILE_ROWSTORE_H_SEEN
+#define FILE_ROWSTORE_H_SEEN
+////////////////////////////////
+// the line store. rows live in a balanced tree ordered by line
+// number, so insert, delete, and lookup by line number are all
+// O(log n) wherever they happen in the file. an erow pointer
+// stays valid until that row is deleted.
+extern erow *editorRowAt(int);
+extern erow *editorRowNext(erow *);
+extern erow *editorRowPrev(erow *);
+extern int editorRowIndex(erow *);
+extern erow *editorRowStoreInsert(int);
+extern erow *editorRowStoreInsertRun(int, int);
+extern void editorRowStoreDelete(int);
+extern void editorRowStoreDeleteRun(int, int);
+extern void editorRowStoreClear();
+
+#endif // !FILE_ROWSTORE_H_SEEN
@@ -0,0 +1,299 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+
+#include "tvi.h"
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "arena.h"
+#include "event.h"
+#include "highlight.h"
+#include "rowstore.h"
+#include "save.h"
+
+/////////////////////////////////////////////////////////////
+// writing the buffer out
+//
+// Saving used to copy the whole buffer into one string the size
+// of the file, truncate the file, and write the string over it,
+// all while the editor waited.
+//
+// Now a save starts by taking a snapshot of the rows: the list
+// of pieces writev should write, a row being the text either
+// side of its gap and a newline. Pieces that sit next to each
+// other are joined, so a run of unedited rows from the mapped
+// file is a single piece and the snapshot of a lightly edited
+// file is small. A worker thread writes the pieces to a temp
+// file next to the original, TVI_SAVE_IOV at a time, syncs it,
+// and renames it over the original. A crash part way through
+// leaves the original alone.
+//
+// Editing goes on meanwhile. Each row in the snapshot is marked
+// with the save's generation. Before such a row's chars change
+// or go away the row gets a new copy, and the old block is only
+// freed when the save is over, see rowMakeWritable. Mapped rows
+// never change in place so they need no marking.
+//
+// The worker never touches the editor's state. It wakes the
+// editor up when there is progress to show, and the editor
+// looks at it then, see editorSavePoll.
+
+#define TVI_SAVE_IOV 1024
+
+static struct {
+  pthread_t tid;
+  int threaded;
+  pthread_mutex_t lock;
+  char *filename;
+  char *tmpname;
+  mode_t mode;
+  int hasmode;
+  struct iovec *iov; // the snapshot
+  long niov;
+  long ivcap;
+  long bytes; // total to write
+  int dirty;  // E.dirty when the snapshot was taken
+  // updated by the worker under lock
+  long written;
+  int finished;
+  int err;
+  // blocks the editor gave up while the save ran
+  void **deferred;
+  size_t *deferredsize;
+  long ndeferred;
+  long defcap;
+  int lastpct;
+} S = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static unsigned int savegen;
+
+static void snapshotAdd(const char *p, size_t len) {
+  if (len == 0)
+    return;
+  if (S.niov > 0) {
+    struct iovec *last = &S.iov[S.niov - 1];
+    if ((const char *)last->iov_base + last->iov_len == p) {
+      last->iov_len += len;
+      S.bytes += len;
+      return;
+    }
+  }
+  if (S.niov == S.ivcap) {
+    S.ivcap = S.ivcap ? S.ivcap * 2 : TVI_SAVE_IOV;
+    S.iov = realloc(S.iov, S.ivcap * sizeof(struct iovec));
+    if (S.iov == NULL)
+      die("snapshotAdd-realloc");
+  }
+  S.iov[S.niov].iov_base = (void *)p;
+  S.iov[S.niov].iov_len = len;
+  S.niov++;
+  S.bytes += len;
+}
+
+static void snapshotAddRow(erow *row) {
+  static const char newline = '\n';
+  const char *nl = &newline;
+  if (row->flags & ROW_MAPPED) {
+    // an unedited row can use the newline that follows it in
+    // the mapping, which keeps it joined to the next one.
+    if (row->chars + row->size < E.map + E.maplen &&
+        row->chars[row->size] == '\n')
+      nl = &row->chars[row->size];
+  } else {
+    row->savegen = E.savegen;
+  }
+  snapshotAdd(row->chars, row->gap);
+  snapshotAdd(&row->chars[row->gap + row->gaplen], row->size - row->gap);
+  snapshotAdd(nl, 1);
+}
+
+// write all of iov, coping with short writes. returns 0 or -1
+// with errno set.
+static int saveWritev(int fd, struct iovec *iov, long n) {
+  while (n > 0) {
+    ssize_t done = writev(fd, iov, n < TVI_SAVE_IOV ? n : TVI_SAVE_IOV);
+    if (done == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    pthread_mutex_lock(&S.lock);
+    S.written += done;
+    pthread_mutex_unlock(&S.lock);
+    editorEventWake();
+    while (n > 0 && (size_t)done >= iov->iov_len) {
+      done -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+  return 0;
+}
+
+static void *saveWorker(void *arg) {
+  (void)arg;
+  int err = 0;
+  int fd = open(S.tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    err = errno;
+  } else {
+    // the new file takes over the old one's permissions
+    if (S.hasmode)
+      fchmod(fd, S.mode);
+    if (saveWritev(fd, S.iov, S.niov) == -1 || fsync(fd) == -1)
+      err = errno;
+    if (close(fd) == -1 && !err)
+      err = errno;
+    if (!err && rename(S.tmpname, S.filename) == -1)
+      err = errno;
+    if (err)
+      unlink(S.tmpname);
+  }
+  pthread_mutex_lock(&S.lock);
+  S.err = err;
+  S.finished = 1;
+  pthread_mutex_unlock(&S.lock);
+  editorEventWake();
+  return NULL;
+}
+
+// called instead of arenaFree for a block the running save may
+// still be writing.
+void editorSaveDeferFree(void *p, size_t size) {
+  if (S.ndeferred == S.defcap) {
+    S.defcap = S.defcap ? S.defcap * 2 : 64;
+    S.deferred = realloc(S.deferred, S.defcap * sizeof(void *));
+    S.deferredsize = realloc(S.deferredsize, S.defcap * sizeof(size_t));
+    if (S.deferred == NULL || S.deferredsize == NULL)
+      die("editorSaveDeferFree-realloc");
+  }
+  S.deferred[S.ndeferred] = p;
+  S.deferredsize[S.ndeferred] = size;
+  S.ndeferred++;
+}
+
+// the worker is done, collect it and report how it went.
+static void saveFinish() {
+  if (S.threaded)
+    pthread_join(S.tid, NULL);
+  long j;
+  for (j = 0; j < S.ndeferred; j++)
+    arenaFree(S.deferred[j], S.deferredsize[j]);
+  S.ndeferred = 0;
+  E.savegen = 0;
+
+  if (S.err) {
+    editorSetStatusMessage(" Can't save! I/O error: %s", strerror(S.err));
+  } else {
+    // edits made during the save are still unsaved
+    E.dirty -= S.dirty;
+    if (E.dirty < 0)
+      E.dirty = 0;
+    editorSetStatusMessage(" %ld bytes written to disk", S.bytes);
+  }
+  free(S.filename);
+  free(S.tmpname);
+  S.filename = S.tmpname = NULL;
+}
+
+// check on a running save. returns 1 if the status message
+// changed and the screen should be redrawn.
+int editorSavePoll() {
+  if (!E.savegen)
+    return 0;
+  pthread_mutex_lock(&S.lock);
+  int finished = S.finished;
+  long written = S.written;
+  pthread_mutex_unlock(&S.lock);
+
+  if (finished) {
+    saveFinish();
+    return 1;
+  }
+  int pct = S.bytes ? written * 100.0 / S.bytes : 100;
+  if (pct == S.lastpct)
+    return 0;
+  S.lastpct = pct;
+  editorSetStatusMessage(" saving %s: %d%%", S.filename, pct);
+  return 1;
+}
+
+// block until a running save is over, as before the buffer goes
+// away.
+void editorSaveWait() {
+  if (E.savegen)
+    saveFinish();
+}
+
+void editorSave() {
+  if (E.savegen) {
+    editorSetStatusMessage(" A save is already running");
+    return;
+  }
+  if (E.filename == NULL) {
+    E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
+    if (E.filename == NULL) {
+      editorSetStatusMessage("Save aborted");
+      return;
+    }
+    editorSelectSyntaxHighlight();
+  }
+
+  S.filename = strdup(E.filename);
+  S.tmpname = malloc(strlen(E.filename) + sizeof(".tvi-save"));
+  if (S.filename == NULL || S.tmpname == NULL)
+    die("editorSave-malloc");
+  sprintf(S.tmpname, "%s.tvi-save", E.filename);
+  struct stat st;
+  S.hasmode = stat(E.filename, &st) == 0;
+  S.mode = S.hasmode ? st.st_mode & 07777 : 0;
+
+  if (++savegen == 0)
+    savegen = 1;
+  E.savegen = savegen;
+  S.niov = 0;
+  S.bytes = 0;
+  erow *row;
+  for (row = editorRowAt(0); row; row = editorRowNext(row))
+    snapshotAddRow(row);
+  S.dirty = E.dirty;
+  S.written = 0;
+  S.finished = 0;
+  S.err = 0;
+  S.lastpct = -1;
+
+  S.threaded = pthread_create(&S.tid, NULL, saveWorker, NULL) == 0;
+  if (!S.threaded) {
+    // no thread, save while the user waits
+    saveWorker(NULL);
+    saveFinish();
+    return;
+  }
+  editorSetStatusMessage(" saving %s", S.filename);
+}
@@ -0,0 +1,35 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+// clang-format on
+
+#ifndef FILE_SAVE_H_SEEN
+#define FILE_SAVE_H_SEEN
+////////////////////////////////
+// writing the buffer back to its file in the background, see
+// save.c
+extern void editorSave();
+extern int editorSavePoll();
+extern void editorSaveWait();
+extern void editorSaveDeferFree(void *, size_t);
+
+#endif // !FILE_SAVE_H_SEEN
@@ -0,0 +1,313 @@
+// vim: noai:et:ts=2:sw=2:sts=2
+// tvi.c troi's smallish vimish editor
+//
+// clang-format off
+//
+// started from my pass through the tutorial
+// at https://viewsourcecode.org/snaptoken/kilo/
+// kilo originally by antirez http://antirez.com/news/108
+// the original work is theirs, I'm just futzing around.
+//
+// kilo released under BSD 2-Clause license
+// https://github.com/antirez/kilo/blob/master/LICENSE
+//
+// tutorial released under
+// CC BY 4.0 https://creativecommons.org/licenses/by/4.0/
+//
+// As I said, I'm just futzing around. Anything I've done here
+// is free to use if you think it's useful. Use at your own
+// risk and honor the original authors.
+//
+// Troy Brumley, October 2020.
+//
+
+
+#include "tvi.h"
+
+#include "screen.h"
+
+/////////////////////////////////////////////////////////////
+// shadow screen
+//
+// The draw functions used to send every row of the screen to
+// the terminal on every refresh, each one ending in an erase to
+// end of line. Now they fill in a grid of cells, a character and
+// an attribute each, and screenFlush compares it with the grid
+// the terminal is known to show. Only the runs of cells that
+// differ are sent, each after a cursor move, and a row whose new
+// tail is blank is finished with an erase to end of line. A
+// keystroke that changes one character costs a few bytes rather
+// than the whole screen.
+//
+// A row with bytes over 127 in either frame is redrawn whole,
+// since a run that starts inside a multibyte character would
+// land in the wrong column.
+//
+// An attribute is an SGR foreground color, 30 through 39, plus
+// SCREEN_REVERSE. The escape sequence for each one is built once,
+// see screenSgrInit.
+//
+// When the text moves up or down by a few lines the terminal is
+// asked to scroll the text area, see screenScroll. The shadow of
+// what it shows is shifted to match, and then the usual compare
+// only finds the lines that scrolled into view.
+//
+// Output collects in one buffer sized from the screen when it is
+// set up, and never grows. Should a frame need more, what is
+// already there is written out and the buffer reused.
+
+#define SCREEN_GAP 8 // equal cells worth bridging rather than moving over
+#define SCREEN_SGR 16
+
+static struct {
+  int rows;
+  int cols;
+  char *cells; // the frame being drawn
+  unsigned char *attrs;
+  char *shown; // what the terminal has
+  unsigned char *shownattrs;
+  int curattr; // what the terminal is drawing with, -1 if not known
+  int hidden;  // the cursor is hidden for this frame
+  long framebytes;
+  char *out; // output for the terminal
+  int outlen;
+  int outcap;
+  // per attribute, the sequence to switch to it from the same
+  // reverse setting and the one to switch to it from anything
+  char sgr[256][SCREEN_SGR];
+  char sgrlen[256];
+  char sgrfull[256][SCREEN_SGR];
+  char sgrfulllen[256];
+} S;
+
+static void screenSgrInit() {
+  int color;
+  for (color = 30; color <= 39; color++) {
+    int plain = color, rev = color | SCREEN_REVERSE;
+    S.sgrlen[plain] = S.sgrlen[rev] =
+        snprintf(S.sgr[plain], SCREEN_SGR, "\x1b[%dm", color);
+    memcpy(S.sgr[rev], S.sgr[plain], SCREEN_SGR);
+    S.sgrfulllen[plain] =
+        snprintf(S.sgrfull[plain], SCREEN_SGR, "\x1b[0;%dm", color);
+    S.sgrfulllen[rev] =
+        snprintf(S.sgrfull[rev], SCREEN_SGR, "\x1b[0;7;%dm", color);
+  }
+}
+
+static void screenWrite() {
+  if (S.outlen)
+    write(STDOUT_FILENO, S.out, S.outlen);
+  S.outlen = 0;
+}
+
+// forget what the terminal shows, the next flush redraws it all.
+void screenInvalidate() {
+  S.curattr = -1;
+  if (S.shown) {
+    memset(S.shown, 0, S.rows * S.cols);
+    memset(S.shownattrs, 0, S.rows * S.cols);
+  }
+}
+
+// start a frame of rows by cols, blank.
+void screenBegin(int rows, int cols) {
+  if (rows != S.rows || cols != S.cols) {
+    size_t n = rows * cols;
+    free(S.cells);
+    free(S.attrs);
+    free(S.shown);
+    free(S.shownattrs);
+    free(S.out);
+    // enough for a full redraw that changes color every few
+    // cells, plus a cursor move per row
+    S.outcap = n * 2 + rows * 32 + 64;
+    S.cells = malloc(n);
+    S.attrs = malloc(n);
+    S.shown = malloc(n);
+    S.shownattrs = malloc(n);
+    S.out = malloc(S.outcap);
+    if (!S.cells || !S.attrs || !S.shown || !S.shownattrs || !S.out)
+      die("screenBegin-malloc");
+    if (S.sgrlen[SCREEN_PLAIN] == 0)
+      screenSgrInit();
+    S.rows = rows;
+    S.cols = cols;
+    S.outlen = 0;
+    screenInvalidate();
+  }
+  memset(S.cells, ' ', S.rows * S.cols);
+  memset(S.attrs, SCREEN_PLAIN, S.rows * S.cols);
+  S.framebytes = 0;
+}
+
+// put len characters at row y, column x, clipped to the screen.
+// returns the column after them.
+int screenPut(int y, int x, const char *s, int len, int attr) {
+  if (y < 0 || y >= S.rows || x >= S.cols)
+    return x;
+  if (x + len > S.cols)
+    len = S.cols - x;
+  if (len <= 0)
+    return x;
+  memcpy(&S.cells[y * S.cols + x], s, len);
+  memset(&S.attrs[y * S.cols + x], attr, len);
+  return x + len;
+}
+
+static void screenEmit(const char *s, int len) {
+  if (S.outlen + len > S.outcap) {
+    screenWrite();
+    if (len > S.outcap) {
+      write(STDOUT_FILENO, s, len);
+      S.framebytes += len;
+      return;
+    }
+  }
+  memcpy(&S.out[S.outlen], s, len);
+  S.outlen += len;
+  S.framebytes += len;
+}
+
+static void screenMove(int y, int x) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+  screenEmit(buf, len);
+}
+
+static void screenAttr(int attr) {
+  if (attr == S.curattr)
+    return;
+  // only a reset turns reverse off
+  if (S.curattr == -1 ||
+      (S.curattr & SCREEN_REVERSE) != (attr & SCREEN_REVERSE))
+    screenEmit(S.sgrfull[attr], S.sgrfulllen[attr]);
+  else
+    screenEmit(S.sgr[attr], S.sgrlen[attr]);
+  S.curattr = attr;
+}
+
+static void screenHide() {
+  if (!S.hidden)
+    screenEmit("\x1b[?25l", 6);
+  S.hidden = 1;
+}
+
+// have the terminal scroll rows top through bottom - 1 up by n
+// lines, or down if n is negative, and shift what we know it
+// shows the same way. the lines scrolled in come up blank. call
+// it between screenBegin and screenFlush.
+void screenScroll(int top, int bottom, int n) {
+  int height = bottom - top;
+  if (S.curattr == -1 || n == 0 || n >= height || -n >= height)
+    return; // nothing known to keep, or nothing to gain
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dr\x1b[%d%c\x1b[r", top + 1,
+                     bottom, n > 0 ? n : -n, n > 0 ? 'S' : 'T');
+  screenHide();
+  screenEmit(buf, len);
+
+  int keep = height - (n > 0 ? n : -n);
+  int from = n > 0 ? top + n : top;
+  int to = n > 0 ? top : top - n;
+  int blank = n > 0 ? top + keep : top;
+  memmove(&S.shown[to * S.cols], &S.shown[from * S.cols], keep * S.cols);
+  memmove(&S.shownattrs[to * S.cols], &S.shownattrs[from * S.cols],
+          keep * S.cols);
+  memset(&S.shown[blank * S.cols], ' ', (height - keep) * S.cols);
+  memset(&S.shownattrs[blank * S.cols], SCREEN_PLAIN, (height - keep) * S.cols);
+}
+
+static int rowHasHighBytes(const char *cells, int cols) {
+  int x;
+  for (x = 0; x < cols; x++)
+    if ((unsigned char)cells[x] > 127)
+      return 1;
+  return 0;
+}
+
+static void screenFlushRow(int y) {
+  char *cells = &S.cells[y * S.cols];
+  unsigned char *attrs = &S.attrs[y * S.cols];
+  char *shown = &S.shown[y * S.cols];
+  unsigned char *shownattrs = &S.shownattrs[y * S.cols];
+
+  if (memcmp(cells, shown, S.cols) == 0 &&
+      memcmp(attrs, shownattrs, S.cols) == 0)
+    return;
+
+  // the new row is blank from tail on
+  int tail = S.cols;
+  while (tail > 0 && cells[tail - 1] == ' ' && attrs[tail - 1] == SCREEN_PLAIN)
+    tail--;
+
+  int whole = rowHasHighBytes(cells, S.cols) || rowHasHighBytes(shown, S.cols);
+  int at = -1; // where the cursor was left
+  int x = 0;
+  while (x < tail) {
+    if (!whole && cells[x] == shown[x] && attrs[x] == shownattrs[x]) {
+      x++;
+      continue;
+    }
+    // a run of changes, taking in short stretches of equal
+    // cells that are cheaper to redraw than to move over
+    int end = x + 1;
+    int same = 0;
+    while (end < tail && (whole || same < SCREEN_GAP)) {
+      if (cells[end] == shown[end] && attrs[end] == shownattrs[end])
+        same++;
+      else
+        same = 0;
+      end++;
+    }
+    if (!whole)
+      end -= same;
+    screenMove(y, x);
+    while (x < end) {
+      int run = x + 1;
+      while (run < end && attrs[run] == attrs[x])
+        run++;
+      screenAttr(attrs[x]);
+      screenEmit(&cells[x], run - x);
+      x = run;
+    }
+    at = x;
+  }
+
+  // clear what the old row had past the new tail
+  int old = S.cols;
+  while (old > tail && shown[old - 1] == ' ' &&
+         shownattrs[old - 1] == SCREEN_PLAIN)
+    old--;
+  if (old > tail) {
+    if (at != tail)
+      screenMove(y, tail);
+    screenAttr(SCREEN_PLAIN);
+    screenEmit("\x1b[K", 3);
+  }
+
+  memcpy(shown, cells, S.cols);
+  memcpy(shownattrs, attrs, S.cols);
+}
+
+// send what changed since the last frame to the terminal, and
+// leave the cursor at row cy, column cx.
+void screenFlush(int cy, int cx) {
+  size_t n = S.rows * S.cols;
+  int changed =
+      memcmp(S.cells, S.shown, n) != 0 || memcmp(S.attrs, S.shownattrs, n) != 0;
+  if (changed) {
+    screenHide(); // while drawing
+    int y;
+    for (y = 0; y < S.rows; y++)
+      screenFlushRow(y);
+    screenAttr(SCREEN_PLAIN);
+  }
+  screenMove(cy, cx);
+  if (S.hidden)
+    screenEmit("\x1b[?25h", 6);
+  S.hidden = 0;
+  screenWrite();
+}
+
+// bytes sent to the terminal by the last flush
+long screenFrameBytes() { return S.framebytes; }
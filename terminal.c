@@ -23,6 +23,7 @@
 // clang-format on
 
 #include "tvi.h"
+#include "event.h"
 #include "highlight.h"
 #include "terminal.h"
 
@@ -30,6 +31,7 @@
 // terminal state and management
 
 void disableRawMode() {
+  write(STDOUT_FILENO, "\x1b[?2004l", 8);
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
     die("disableRawMode-tcsetattr");
 }
@@ -49,72 +51,212 @@ void enableRawMode() {
 
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
     die("enableRawMode-tcsetattr");
+
+  // have the terminal bracket pasted text, see editorReadPaste
+  write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
-int editorReadKey() {
-  int nread;
-  char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN)
-      die("editorReadKey-read");
+////////////////////////////////////////////////////
+// keyboard input
+//
+// Input is read into a buffer, as much as is waiting in one go,
+// and keys are decoded from the buffer. A key that starts with
+// ESC is run through the small state machine in keyMachine to
+// find where the sequence ends, and the whole sequence is then
+// looked up in keySeqs. A sequence that isn't known is dropped
+// rather than being typed in as text.
+//
+// A sequence split across reads waits up to E.esctimeout
+// milliseconds for the rest of it. If nothing comes, the ESC was
+// the escape key on its own and whatever followed it is read as
+// ordinary keys.
+
+#define INPUT_BUF 4096
+
+static struct {
+  char buf[INPUT_BUF];
+  int start; // next byte to decode
+  int end;
+} In;
+
+enum keyState { KS_START, KS_ESC, KS_CSI, KS_SS3, KS_DONE, KS_BAD };
+
+enum keyClass {
+  KC_ESC,
+  KC_BRACKET,
+  KC_O,
+  KC_PARAM, // 0x30 - 0x3f, digits and ;
+  KC_INTER, // 0x20 - 0x2f
+  KC_FINAL, // anything else that ends a sequence, 0x40 - 0x7e
+  KC_OTHER,
+  KC_COUNT
+};
+
+// the next state from each state on each class of byte
+static const unsigned char keyMachine[KS_DONE][KC_COUNT] = {
+    // ESC     [        O        param    inter    final    other
+    {KS_ESC, KS_DONE, KS_DONE, KS_DONE, KS_DONE, KS_DONE, KS_DONE}, // start
+    {KS_BAD, KS_CSI, KS_SS3, KS_BAD, KS_BAD, KS_BAD, KS_BAD},       // ESC
+    {KS_BAD, KS_DONE, KS_DONE, KS_CSI, KS_CSI, KS_DONE, KS_BAD},    // ESC [
+    {KS_BAD, KS_DONE, KS_DONE, KS_SS3, KS_BAD, KS_DONE, KS_BAD},    // ESC O
+};
+
+static const struct {
+  const char *seq; // after the ESC
+  int key;
+} keySeqs[] = {
+    {"[A", ARROW_UP},     {"[B", ARROW_DOWN},     {"[C", ARROW_RIGHT},
+    {"[D", ARROW_LEFT},   {"OA", ARROW_UP},       {"OB", ARROW_DOWN},
+    {"OC", ARROW_RIGHT},  {"OD", ARROW_LEFT},     {"[H", HOME_KEY},
+    {"[F", END_KEY},      {"OH", HOME_KEY},       {"OF", END_KEY},
+    {"[1~", HOME_KEY},    {"[3~", DEL_KEY},       {"[4~", END_KEY},
+    {"[5~", PAGE_UP},     {"[6~", PAGE_DOWN},     {"[7~", HOME_KEY},
+    {"[8~", END_KEY},     {"[200~", PASTE_START},
+};
+
+static int keyClass(unsigned char c) {
+  if (c == '\x1b')
+    return KC_ESC;
+  if (c == '[')
+    return KC_BRACKET;
+  if (c == 'O')
+    return KC_O;
+  if (c >= 0x30 && c <= 0x3f)
+    return KC_PARAM;
+  if (c >= 0x20 && c <= 0x2f)
+    return KC_INTER;
+  if (c >= 0x40 && c <= 0x7e)
+    return KC_FINAL;
+  return KC_OTHER;
+}
+
+// read whatever input is waiting, first waiting up to ms for
+// some to arrive (-1 waits for good). returns the bytes read.
+static int inputFill(int ms) {
+  if (In.start == In.end)
+    In.start = In.end = 0;
+  if (In.end == INPUT_BUF) {
+    if (In.start == 0)
+      return 0; // full, decode some first
+    memmove(In.buf, &In.buf[In.start], In.end - In.start);
+    In.end -= In.start;
+    In.start = 0;
   }
+  if (!editorWaitInput(ms))
+    return 0;
+  int nread = read(STDIN_FILENO, &In.buf[In.end], INPUT_BUF - In.end);
+  if (nread == -1) {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    die("inputFill-read");
+  }
+  In.end += nread;
+  return nread;
+}
 
-  if (c == '\x1b') {
-    char seq[3];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
-      return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
-      return '\x1b';
-    if (seq[0] == '[') {
-      if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1)
-          return '\x1b';
-        if (seq[2] == '~') {
-          switch (seq[1]) {
-          case '1':
-            return HOME_KEY;
-          case '3':
-            return DEL_KEY;
-          case '4':
-            return END_KEY;
-          case '5':
-            return PAGE_UP;
-          case '6':
-            return PAGE_DOWN;
-          case '7':
-            return HOME_KEY;
-          case '8':
-            return END_KEY;
-          }
-        }
-      } else {
-        switch (seq[1]) {
-        case 'A':
-          return ARROW_UP;
-        case 'B':
-          return ARROW_DOWN;
-        case 'C':
-          return ARROW_RIGHT;
-        case 'D':
-          return ARROW_LEFT;
-        case 'H':
-          return HOME_KEY;
-        case 'F':
-          return END_KEY;
-        }
-      }
-    } else if (seq[0] == '0') {
-      switch (seq[1]) {
-      case 'H':
-        return HOME_KEY;
-      case 'F':
-        return END_KEY;
+// decode the key at the front of the buffer. returns KEY_NONE if
+// there isn't a whole one yet.
+static int keyDecode() {
+  int state = KS_START;
+  int i = In.start;
+  while (1) {
+    if (i == In.end) {
+      if (state == KS_START)
+        return KEY_NONE;
+      // part of a sequence, give the rest a moment to arrive
+      int off = i - In.start; // filling can move the buffer
+      if (inputFill(E.esctimeout) > 0) {
+        i = In.start + off;
+        continue;
       }
+      state = KS_BAD;
+      break;
     }
+    state = keyMachine[state][keyClass(In.buf[i++])];
+    if (state >= KS_DONE)
+      break;
+  }
+
+  if (state == KS_BAD) {
+    // ESC on its own, whatever follows is read again
+    In.start++;
     return '\x1b';
-  } else {
-    return c;
   }
+  int len = i - In.start;
+  char *seq = &In.buf[In.start];
+  In.start = i;
+  if (len == 1)
+    return seq[0];
+  size_t j;
+  for (j = 0; j < sizeof(keySeqs) / sizeof(keySeqs[0]); j++)
+    if ((int)strlen(keySeqs[j].seq) == len - 1 &&
+        memcmp(keySeqs[j].seq, &seq[1], len - 1) == 0)
+      return keySeqs[j].key;
+  return KEY_IGNORED;
+}
+
+// the next key if one has been typed, or KEY_NONE. doesn't
+// wait, other than to finish an escape sequence.
+int editorReadKeyNow() {
+  int c;
+  do {
+    if (In.start == In.end)
+      inputFill(0);
+    c = keyDecode();
+  } while (c == KEY_IGNORED);
+  return c;
+}
+
+int editorReadKey() {
+  int c;
+  while ((c = editorReadKeyNow()) == KEY_NONE)
+    inputFill(-1);
+  return c;
+}
+
+// After editorReadKey returns PASTE_START, read the pasted text
+// up to the closing ESC [ 201 ~ and return it in a malloc'd
+// buffer, its length in *len. Line breaks are left as the
+// terminal sent them.
+char *editorReadPaste(size_t *len) {
+  static const char end[] = "\x1b[201~";
+  int endlen = sizeof(end) - 1;
+  size_t cap = 4096, n = 0;
+  char *buf = malloc(cap);
+  if (buf == NULL)
+    die("editorReadPaste-malloc");
+  while (1) {
+    int avail = In.end - In.start;
+    char *at = memmem(&In.buf[In.start], avail, end, endlen);
+    // take everything before the end marker, or everything that
+    // can't be the start of one
+    int take = at ? at - &In.buf[In.start] : avail - (endlen - 1);
+    if (take < 0)
+      take = 0;
+    if (n + take > cap) {
+      while (n + take > cap)
+        cap *= 2;
+      buf = realloc(buf, cap);
+      if (buf == NULL)
+        die("editorReadPaste-realloc");
+    }
+    memcpy(&buf[n], &In.buf[In.start], take);
+    n += take;
+    In.start += take;
+    if (at) {
+      In.start += endlen;
+      break;
+    }
+    inputFill(-1);
+  }
+  *len = n;
+  return buf;
+}
+
+// wait up to ms milliseconds for input. returns 1 if a key can
+// be read without blocking.
+int editorKeyWaiting(int ms) {
+  return In.start < In.end || inputFill(ms) > 0;
 }
 
 int getCursorPosition(int *rows, int *cols) {
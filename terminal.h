@@ -33,5 +33,8 @@ extern void enableRawMode();
 extern void disableRawMode();
 extern int getWindowSize(int*, int*);
 extern int editorReadKey();
+extern int editorReadKeyNow();
+extern int editorKeyWaiting(int);
+extern char *editorReadPaste(size_t *);
 
 #endif // !FILE_TERMINAL_H_SEEN
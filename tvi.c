@@ -67,6 +67,13 @@
 #include "highlight.h"
 #include "terminal.h"
 #include "rowscreen.h"
+#include "rowstore.h"
+#include "arena.h"
+#include "lineindex.h"
+#include "bench.h"
+#include "save.h"
+#include "screen.h"
+#include "event.h"
 
 struct editorConfig E;
 
@@ -89,28 +96,59 @@ void die(const char *s) {
 ///////////////////////////////////////////////////////////
 // file access
 
-char *editorRowsToString(int *buflen) {
-  int totlen = 0;
-  int j;
-  for (j = 0; j < E.numrows; j++)
-    totlen += E.row[j].size + 1;
-  *buflen = totlen;
-
-  char *buf = malloc(totlen); // really? I'd buffer in case memory is an issue
-  char *p = buf;
-  for (j = 0; j < E.numrows; j++) {
-    memcpy(p, E.row[j].chars, E.row[j].size);
-    p += E.row[j].size;
-    *p = '\n';
-    p++;
+// Map the file and point each row into the mapping instead of
+// copying it line by line. A row only gets its own copy once it
+// is edited, so opening a huge file costs one pass to find the
+// line breaks and a row per line. Returns 0 if the file can't be
+// mapped, such as a pipe or an empty file.
+int editorOpenMapped(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return 0;
+
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return 0;
+  E.map = map;
+  E.maplen = st.st_size;
+
+  size_t *off;
+  long lines = editorIndexLines(map, st.st_size, &off);
+  erow *row = editorRowStoreInsertRun(E.numrows, lines);
+  long j;
+  for (j = 0; j < lines; j++) {
+    size_t linelen = off[j + 1] - off[j];
+    while (linelen > 0 && (map[off[j] + linelen - 1] == '\n' ||
+                           map[off[j] + linelen - 1] == '\r'))
+      linelen--;
+    editorMapRow(row, &map[off[j]], linelen);
+    row = editorRowNext(row);
+  }
+  free(off);
+  return 1;
+}
+
+// let go of the buffer and everything loaded with it.
+void editorCloseFile() {
+  editorSaveWait();
+  editorFreeRows();
+  if (E.map) {
+    munmap(E.map, E.maplen);
+    E.map = NULL;
+    E.maplen = 0;
   }
-  return buf;
+  free(E.filename);
+  E.filename = NULL;
+  E.cx = E.cy = E.rx = 0;
+  E.rowoff = E.coloff = 0;
+  E.dirty = 0;
 }
 
 void editorOpen(char *filename) {
   /* TODO: if file does not exist, we shouldn't crash.
      Instead, offer to create a new file or exit gracefully. */
 
+  editorCloseFile();
   E.filename = strdup(filename);
 
   editorSelectSyntaxHighlight();
@@ -119,6 +157,12 @@ void editorOpen(char *filename) {
   if (!fp)
     die("editorOpen-fopen");
 
+  if (editorOpenMapped(fileno(fp))) {
+    fclose(fp);
+    E.dirty = 0;
+    return;
+  }
+
   char *line = NULL;
   size_t linecap = 0;
   ssize_t maxlinelen = -1;
@@ -136,51 +180,16 @@ void editorOpen(char *filename) {
   E.dirty = 0;
 }
 
-void editorSave() {
-  if (E.filename == NULL) {
-    E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
-    if (E.filename == NULL) {
-      editorSetStatusMessage("Save aborted");
-      return;
-    }
-    editorSelectSyntaxHighlight();
-  }
-
-  int len;
-  char *buf = editorRowsToString(&len);
-
-  int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      if (write(fd, buf, len) == len) {
-        close(fd);
-        free(buf);
-        E.dirty = 0;
-        editorSetStatusMessage(" %d bytes written to disk", len);
-        return;
-      }
-    }
-    close(fd);
-  }
-  free(buf);
-  editorSetStatusMessage(" Can't save! I/O error: %s", strerror(errno));
-}
-
 ////////////////////////////////////////////////////
 // search and maybe someday replace
 
+// the match is drawn over the row's highlight by editorDrawRows,
+// the row's hl is never touched.
 void editorFindCallback(char *query, int key) {
   static int last_match = -1;
   static int direction = 1;
 
-  static int saved_hl_line;
-  static char *saved_hl = NULL;
-
-  if (saved_hl) {
-    memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize);
-    free(saved_hl);
-    saved_hl = NULL;
-  }
+  E.matchrow = -1;
 
   if (key == '\r' || key == '\x1b') {
     last_match = -1;
@@ -206,18 +215,19 @@ void editorFindCallback(char *query, int key) {
     else if (current == E.numrows)
       current = 0;
 
-    erow *row = &E.row[current];
-    char *match = strstr(row->render, query);
+    erow *row = editorPrepareRow(current);
+    // a row without tabs renders straight from chars, which
+    // aren't '\0' terminated
+    char *match = memmem(row->render, row->rsize, query, strlen(query));
     if (match) {
       last_match = current;
       E.cy = current;
       E.cx = editorRowRxToCx(row, match - row->render);
       E.rowoff = E.numrows;
 
-      saved_hl_line = current;
-      saved_hl = malloc(row->rsize);
-      memcpy(saved_hl, row->hl, row->rsize);
-      memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
+      E.matchrow = current;
+      E.matchrx = match - row->render;
+      E.matchlen = strlen(query);
       break;
     }
   }
@@ -249,27 +259,13 @@ void editorFind() {
   }
 }
 
-/*** append buffer ***/
-
-void abAppend(struct abuf *ab, const char *s, int len) {
-  char *new = realloc(ab->b, ab->len + len);
-
-  if (new == NULL)
-    return;
-  memcpy(&new[ab->len], s, len);
-  ab->b = new;
-  ab->len += len;
-}
-
-void abFree(struct abuf *ab) { free(ab->b); }
-
 /////////////////////////////////////////////////
 // screen display
 
 void editorScroll() {
   E.rx = 0;
   if (E.cy < E.numrows) {
-    E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+    E.rx = editorRowCxToRx(editorRowAt(E.cy), E.cx);
   }
 
   if (E.cy < E.rowoff) {
@@ -286,11 +282,22 @@ void editorScroll() {
   }
 }
 
-void editorDrawRows(struct abuf *ab) {
+void editorDrawRows() {
+  // the screen attribute for each highlight
+  int colors[HL_PUNCTUATION + 1];
   int y;
+  for (y = 0; y <= HL_PUNCTUATION; y++)
+    colors[y] = y == HL_NORMAL ? SCREEN_PLAIN : editorSyntaxToColor(y);
+
+  // rows the highlighter hasn't got to yet go out plain instead
+  // of holding up the screen. it wakes us when they're ready.
+  E.hlplain = 0;
   for (y = 0; y < E.screenrows; y++) {
-    int filerow = y + E.rowoff;
-    if (filerow >= E.numrows) {
+    erow *row = editorShowRow(y + E.rowoff);
+    int plain = E.syntax && E.hlthread && y + E.rowoff >= E.hlfrontier;
+    if (row && plain)
+      E.hlplain = 1;
+    if (row == NULL) {
       if (E.numrows == 0 && y == E.screenrows / 3) {
         char welcome[80];
         int welcomelen = snprintf(welcome, sizeof(welcome),
@@ -298,65 +305,51 @@ void editorDrawRows(struct abuf *ab) {
         if (welcomelen > E.screencols)
           welcomelen = E.screencols;
         int padding = (E.screencols - welcomelen) / 2;
-        // oh god this hurts but will fix it after i'm through
-        // the tutorial
-        if (padding) {
-          abAppend(ab, "~", 1);
-          padding--;
-        }
-        while (padding--)
-          abAppend(ab, " ", 1);
-        abAppend(ab, welcome, welcomelen);
+        if (padding)
+          screenPut(y, 0, "~", 1, SCREEN_PLAIN);
+        screenPut(y, padding, welcome, welcomelen, SCREEN_PLAIN);
       } else {
-        abAppend(ab, "~", 1);
+        screenPut(y, 0, "~", 1, SCREEN_PLAIN);
       }
     } else {
-      int len = E.row[filerow].rsize - E.coloff;
+      int len = row->rsize - E.coloff;
       if (len < 0)
         len = 0;
       if (len > E.screencols)
         len = E.screencols;
-      char *c = &E.row[filerow].render[E.coloff];
-      unsigned char *hl = &E.row[filerow].hl[E.coloff];
-      int current_color = -1;
-      int j;
-      for (j = 0; j < len; j++) {
-        if (hl[j] == HL_NORMAL) {
-          if (iscntrl(c[j])) {
-            char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-            abAppend(ab, "\x1b[7m", 4);
-            abAppend(ab, &sym, 1);
-            abAppend(ab, "\x1b[m", 3);
-            if (current_color != -1) {
-              char buf[16];
-              int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-              abAppend(ab, buf, clen);
-            }
-          } else if (current_color != -1) {
-            abAppend(ab, "\x1b[39m", 5);
-            current_color = -1;
-          }
-          abAppend(ab, &c[j], 1);
-        } else {
-          int color = editorSyntaxToColor(hl[j]);
-          if (color != current_color) {
-            current_color = color;
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-            abAppend(ab, buf, clen);
-          }
-          abAppend(ab, &c[j], 1);
+      char *c = &row->render[E.coloff];
+      unsigned char *hl = &row->hl[E.coloff];
+      // screen columns from and to of a find match, if there's
+      // one on this row
+      int from = -1, to = -1;
+      if (y + E.rowoff == E.matchrow) {
+        from = E.matchrx - E.coloff;
+        to = from + E.matchlen;
+      }
+      int j = 0;
+      while (j < len) {
+        if (iscntrl(c[j])) {
+          char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+          screenPut(y, j, &sym, 1, SCREEN_PLAIN | SCREEN_REVERSE);
+          j++;
+          continue;
         }
+        // the run of characters with the same highlight
+        int match = j >= from && j < to;
+        int k = j + 1;
+        while (k < len && (k >= from && k < to) == match &&
+               (match || plain || hl[k] == hl[j]) && !iscntrl(c[k]))
+          k++;
+        int color = match ? colors[HL_MATCH]
+                          : plain ? SCREEN_PLAIN : colors[hl[j]];
+        screenPut(y, j, &c[j], k - j, color);
+        j = k;
       }
-      abAppend(ab, "\x1b[39m", 5);
     }
-    abAppend(ab, "\x1b[K", 3);
-    abAppend(ab, "\r\n", 2);
   }
 }
 
-void editorDrawStatusBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[7m", 4);
+void editorDrawStatusBar() {
   char status[80];
   char rstatus[80];
   int len = snprintf(status, sizeof(status), " %.20s - %d lines %s",
@@ -367,50 +360,44 @@ void editorDrawStatusBar(struct abuf *ab) {
                E.syntax ? E.syntax->filetype : "no ft", E.cy + 1, E.numrows);
   if (len > E.screencols)
     len = E.screencols;
-  abAppend(ab, status, len);
-  while (len < E.screencols) {
-    if (E.screencols - len == rlen) {
-      abAppend(ab, rstatus, rlen);
-      break;
-    } else {
-      abAppend(ab, " ", 1);
-      len++;
-    }
-  }
-  abAppend(ab, "\x1b[m", 3);
-  abAppend(ab, "\r\n", 2);
+  int y = E.screenrows;
+  int x;
+  for (x = 0; x < E.screencols; x++)
+    screenPut(y, x, " ", 1, SCREEN_PLAIN | SCREEN_REVERSE);
+  screenPut(y, 0, status, len, SCREEN_PLAIN | SCREEN_REVERSE);
+  if (E.screencols - len >= rlen)
+    screenPut(y, E.screencols - rlen, rstatus, rlen,
+              SCREEN_PLAIN | SCREEN_REVERSE);
 }
 
-void editorDrawMessageBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[K", 3);
+void editorDrawMessageBar() {
   int msglen = strlen(E.statusmsg);
   if (msglen > E.screencols)
     msglen = E.screencols;
-  if (msglen && time(NULL) - E.statusmsg_time < 5)
-    abAppend(ab, E.statusmsg, msglen);
+  if (msglen && time(NULL) - E.statusmsg_time < TVI_STATUS_TIME)
+    screenPut(E.screenrows + 1, 0, E.statusmsg, msglen, SCREEN_PLAIN);
 }
 
 void editorRefreshScreen() {
-  editorScroll();
-
-  struct abuf ab = ABUF_INIT;
+  // where the text was on the last refresh
+  static int shownrowoff = 0;
+  static int showncoloff = 0;
 
-  abAppend(&ab, "\x1b[?25l", 6); // disable cursor, not all older vts support
-  // abAppend(&ab, "\x1b[2J", 4); // erase display
-  abAppend(&ab, "\x1b[H", 3); // home cursor
+  editorScroll();
 
-  editorDrawRows(&ab);
-  editorDrawStatusBar(&ab);
-  editorDrawMessageBar(&ab);
+  screenBegin(E.screenrows + 2, E.screencols);
+  editorDrawRows();
+  editorDrawStatusBar();
+  editorDrawMessageBar();
 
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1,
-           (E.rx - E.coloff) + 1);
-  abAppend(&ab, buf, strlen(buf));
+  // text that moved up or down can be scrolled by the terminal
+  // instead of being drawn again
+  if (E.coloff == showncoloff)
+    screenScroll(0, E.screenrows, E.rowoff - shownrowoff);
+  shownrowoff = E.rowoff;
+  showncoloff = E.coloff;
 
-  abAppend(&ab, "\x1b[?25h", 6); // enable cursor
-  write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
+  screenFlush(E.cy - E.rowoff, E.rx - E.coloff);
 }
 
 void editorSetStatusMessage(const char *fmt, ...) {
@@ -419,6 +406,8 @@ void editorSetStatusMessage(const char *fmt, ...) {
   vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
   va_end(ap);
   E.statusmsg_time = time(NULL);
+  // redraw without it once its time is up
+  editorEventStatusTimer(TVI_STATUS_TIME * 1000);
 }
 
 /////////////////////////////////////////////////
@@ -436,7 +425,22 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
     editorRefreshScreen();
 
     int c = editorReadKey();
-    if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
+    if (c == PASTE_START) {
+      // take the first line of a paste as typed
+      size_t len, j;
+      char *text = editorReadPaste(&len);
+      for (j = 0; j < len && text[j] != '\r' && text[j] != '\n'; j++) {
+        if (iscntrl(text[j]) || (unsigned char)text[j] >= 128)
+          continue;
+        if (buflen == bufsize - 1) {
+          bufsize *= 2;
+          buf = realloc(buf, bufsize);
+        }
+        buf[buflen++] = text[j];
+        buf[buflen] = '\0';
+      }
+      free(text);
+    } else if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
       if (buflen != 0)
         buf[--buflen] = '\0';
     } else if (c == '\x1b') {
@@ -469,7 +473,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
 // cursoring
 
 void editorMoveCursor(int key) {
-  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  erow *row = editorRowAt(E.cy);
 
   switch (key) {
   case ARROW_LEFT:
@@ -477,7 +481,7 @@ void editorMoveCursor(int key) {
       E.cx--;
     } else if (E.cy > 0) {
       E.cy--;
-      E.cx = E.row[E.cy].size;
+      E.cx = editorRowAt(E.cy)->size;
     }
     break;
   case ARROW_RIGHT:
@@ -500,12 +504,80 @@ void editorMoveCursor(int key) {
       E.cy++;
     break;
   }
-  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  row = editorRowAt(E.cy);
+  int rowlen = row ? row->size : 0;
+  if (E.cx > rowlen)
+    E.cx = rowlen;
+}
+
+// move for a motion typed with a count in front, 10000j or 50G.
+// the target is worked out directly instead of stepping there,
+// so a count of a million costs the same as no count at all. a
+// count of 0 means none was typed, which only matters for G.
+// counted h and l stay on the line the way vi's do.
+void editorMotion(int key, int count) {
+  int n = count ? count : 1;
+  int page = E.screenrows > 0 ? E.screenrows : 1;
+  erow *row;
+
+  switch (key) {
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+    if (n == 1) {
+      editorMoveCursor(key);
+      return;
+    }
+    row = editorRowAt(E.cy);
+    if (key == ARROW_LEFT)
+      E.cx = E.cx > n ? E.cx - n : 0;
+    else if (row)
+      E.cx = row->size - E.cx > n ? E.cx + n : row->size;
+    return;
+  case ARROW_UP:
+    E.cy = E.cy > n ? E.cy - n : 0;
+    break;
+  case ARROW_DOWN:
+    E.cy = E.numrows - E.cy > n ? E.cy + n : E.numrows;
+    break;
+  case PAGE_UP:
+    // a page is a screenful back from the top of the screen
+    if (E.rowoff / page >= n)
+      E.cy = E.rowoff - n * page;
+    else
+      E.cy = 0;
+    break;
+  case PAGE_DOWN:
+    // and a screenful on from the bottom of it
+    E.cy = E.rowoff + page - 1;
+    if ((E.numrows - E.cy) / page >= n)
+      E.cy += n * page;
+    else
+      E.cy = E.numrows;
+    break;
+  case 'G':
+    // line count, or the last line without one
+    if (count == 0 || count > E.numrows)
+      count = E.numrows;
+    E.cy = count > 0 ? count - 1 : 0;
+    E.cx = 0;
+    break;
+  }
+  row = editorRowAt(E.cy);
   int rowlen = row ? row->size : 0;
   if (E.cx > rowlen)
     E.cx = rowlen;
 }
 
+// dd, delete count lines from the cursor down.
+void editorDeleteLines(int count) {
+  if (E.cy >= E.numrows)
+    return;
+  editorDelRows(E.cy, count ? count : 1);
+  if (E.cy >= E.numrows && E.numrows > 0)
+    E.cy = E.numrows - 1;
+  E.cx = 0;
+}
+
 //////////////////////////////////////////////////////
 // handle a keypress
 
@@ -571,6 +643,7 @@ void editorProcessEXKeypress(int c) {
     }
     write(STDOUT_FILENO, "\x1b[2J", 4); // erase display
     write(STDOUT_FILENO, "\x1b[H", 3);  // home cursor
+    editorCloseFile();
     exit(0);
 
   case 'w':
@@ -601,6 +674,11 @@ int translateViKeys(int c) {
   case 'a':
     // insert after, does nothing right now
     return 0;
+  case '0':
+    // a 0 that isn't part of a count
+    return HOME_KEY;
+  case '$':
+    return END_KEY;
   case CTRL_KEY('f'):
     return PAGE_DOWN;
   case CTRL_KEY('b'):
@@ -609,8 +687,11 @@ int translateViKeys(int c) {
   return c;
 }
 
-void editorProcessKeypress() {
+void editorProcessKeypress(int c) {
   static int quit_times = TVI_QUIT_TIMES;
+  static int count = 0;   // count typed so far, 0 for none
+  static int pending = 0; // operator waiting for its motion
+  static int opcount = 0; // count typed before the operator
 
   // probably need to break this out at a high level by mode,
   // and then process keys applicable to that mode. we'll get
@@ -621,7 +702,16 @@ void editorProcessKeypress() {
   // full vi allows cursor movement while in input mode but
   // i probably won't.
 
-  int c = editorReadKey();
+  // a paste goes in as text in one go, whatever the mode, the
+  // way vim does it. only the status line ignores it.
+  if (c == PASTE_START) {
+    size_t len;
+    char *text = editorReadPaste(&len);
+    if (E.mode != EM_COMMAND)
+      editorInsertText(text, len);
+    free(text);
+    return;
+  }
 
   if (E.mode == EM_INSERT) {
     editorProcessInsertKeypress(c);
@@ -634,6 +724,30 @@ void editorProcessKeypress() {
     return;
   }
 
+  // collect a count, only a leading 0 is a motion
+  if ((c >= '1' && c <= '9') || (c == '0' && count)) {
+    count = count * 10 + c - '0';
+    if (count > TVI_MAX_COUNT)
+      count = TVI_MAX_COUNT;
+    return;
+  }
+
+  // an operator takes the next key as its motion. dd is the
+  // only one so far, anything else just cancels it. counts on
+  // both sides multiply, 2d3d deletes six lines.
+  if (pending) {
+    if (c == pending) {
+      long long n = (long long)(opcount ? opcount : 1) * (count ? count : 1);
+      editorDeleteLines(n > TVI_MAX_COUNT ? TVI_MAX_COUNT : (int)n);
+    }
+    pending = 0;
+    count = 0;
+    return;
+  }
+
+  int n = count;
+  count = 0;
+
   // in normal mode, be sure to remap vi style movement keys
   c = translateViKeys(c);
 
@@ -681,6 +795,7 @@ void editorProcessKeypress() {
     }
     write(STDOUT_FILENO, "\x1b[2J", 4); // erase display
     write(STDOUT_FILENO, "\x1b[H", 3);  // home cursor
+    editorCloseFile();
     exit(0);
     break;
 
@@ -694,38 +809,43 @@ void editorProcessKeypress() {
 
   case END_KEY:
     if (E.cy < E.numrows)
-      E.cx = E.row[E.cy].size;
+      E.cx = editorRowAt(E.cy)->size;
     break;
 
   case CTRL_KEY('t'):
     E.highlighting = !E.highlighting;
     break;
 
-  case PAGE_UP:
-  case PAGE_DOWN: {
-    if (c == PAGE_UP)
-      E.cy = E.rowoff;
-    if (c == PAGE_DOWN) {
-      E.cy = E.rowoff + E.screenrows - 1;
-      if (E.cy > E.numrows)
-        E.cy = E.numrows;
-    }
-    int times = E.screenrows;
-    while (times--)
-      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+  case CTRL_KEY('g'): {
+    // file info, what the rows cost against plain malloc, and
+    // what the last screen update cost
+    struct arenaStats st;
+    arenaGetStats(&st);
+    editorSetStatusMessage(" %d lines, rows %zuK (malloc %zuK), "
+                           "last frame %ld bytes",
+                           E.numrows, st.reserved / 1024,
+                           st.mallocwould / 1024, screenFrameBytes());
     break;
   }
 
+  case PAGE_UP:
+  case PAGE_DOWN:
   case ARROW_UP:
   case ARROW_DOWN:
   case ARROW_LEFT:
   case ARROW_RIGHT:
-    editorMoveCursor(c);
+  case 'G':
+    editorMotion(c, n);
     break;
 
+  case 'd':
+    pending = c;
+    opcount = n;
+    return;
+
   case CTRL_KEY('l'):
-    // this is a clear or repaint screen command usually, i'm not sure why
-    // it's blocked out here, must review the tutorial.
+    // repaint the whole screen on the next refresh
+    screenInvalidate();
     break;
 
   default:
@@ -746,7 +866,16 @@ void initEditor() {
   E.rowoff = 0;
   E.coloff = 0;
   E.numrows = 0;
-  E.row = NULL;
+  E.rowtree = NULL;
+  E.map = NULL;
+  E.maplen = 0;
+  E.hlfrontier = 0;
+  E.hlresume = 0;
+  E.hlplain = 0;
+  E.rowcache = NULL;
+  E.rowcachesize = 0;
+  E.rowcachenext = 0;
+  E.savegen = 0;
   E.filename = NULL;
   E.statusmsg[0] = '\0';
   E.statusmsg_time = 0;
@@ -758,26 +887,94 @@ void initEditor() {
   E.mode = EM_NORMAL;
   E.findForward = 1;
   E.findString = NULL;
+  E.matchrow = -1;
+  E.framerate = TVI_FRAME_RATE;
+  E.esctimeout = TVI_ESC_TIMEOUT;
 }
 
 ///////////////////////////////////////////////////////////////////
 // main, fire it up
 
+// a whole number of 0 or more for an option, -1 if it isn't one.
+static int optionNumber(const char *s) {
+  char *end;
+  errno = 0;
+  long n = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || errno || n < 0 || n > INT_MAX)
+    return -1;
+  return n;
+}
+
+static long editorMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
 int main(int argc, char *argv[]) {
+  int framerate = TVI_FRAME_RATE;
+  int esctimeout = TVI_ESC_TIMEOUT;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:f:")) != -1) {
+    switch (opt) {
+    case 'b':
+      initializeKeywordTables();
+      return editorBenchmark(optarg, argv[optind]);
+    case 'e':
+      // a negative timeout would have a lone escape wait forever
+      esctimeout = optionNumber(optarg);
+      if (esctimeout < 0)
+        opt = '?';
+      break;
+    case 'f':
+      // 0 is no limit
+      framerate = optionNumber(optarg);
+      if (framerate < 0)
+        opt = '?';
+      break;
+    }
+    if (opt == '?') {
+      fprintf(stderr, "usage: tvi [-e escape ms] [-f frames a second] "
+                      "[-b benchmark file] [file]\n");
+      return 1;
+    }
+  }
+
   initializeKeywordTables();
   enableRawMode();
   initEditor();
-  if (argc >= 2) {
-    editorOpen(argv[1]);
+  E.framerate = framerate;
+  E.esctimeout = esctimeout;
+  editorEventInit();
+  editorLock();
+  if (optind < argc) {
+    editorOpen(argv[optind]);
   }
 
   editorSetStatusMessage(
       " HELP: <esc>:q! = quit, <esc>:w = save, <esc>/ = find, "
       "Ctrl-T = toggle hilighting");
 
+  // draw, wait for a key, then deal with every key that is
+  // already waiting, or that turns up before the next frame is
+  // due, before drawing again. a paste is one frame, not one
+  // per character.
   while (1) {
     editorRefreshScreen();
-    editorProcessKeypress();
+    long drawn = editorMillis();
+    editorProcessKeypress(editorReadKey());
+    while (1) {
+      int c = editorReadKeyNow();
+      if (c != KEY_NONE) {
+        editorProcessKeypress(c);
+        continue;
+      }
+      long wait = 0;
+      if (E.framerate > 0)
+        wait = drawn + 1000 / E.framerate - editorMillis();
+      if (wait <= 0 || !editorKeyWaiting(wait))
+        break;
+    }
   };
 
   return 0;
@@ -32,11 +32,14 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <time.h>
@@ -45,6 +48,13 @@
 #define TVI_VERSION "0.0.1"
 #define TVI_TAB_STOP 8
 #define TVI_QUIT_TIMES 3
+#define TVI_ROW_GAP 16
+#define TVI_ROW_CACHE 256
+#define TVI_FRAME_RATE 60 // most screen updates a second, -f to change
+#define TVI_STATUS_TIME 5 // seconds a status message stays up
+#define TVI_ESC_TIMEOUT 50 // ms to wait for the rest of a key, -e to change
+#define TVI_MAX_COUNT 99999999 // largest count typed before a command
+#define TVI_HL_BATCH 4096 // rows the highlighter does before letting go
 
 ///////////////////////////////////////////////////////////
 // modes
@@ -64,7 +74,10 @@ enum editorKey {
   HOME_KEY,
   END_KEY,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  PASTE_START, // the text follows, see editorReadPaste
+  KEY_NONE,    // nothing typed yet, see editorReadKeyNow
+  KEY_IGNORED  // an escape sequence we don't know
 };
 
 ///////////////////////////////////////////////
@@ -92,30 +105,51 @@ enum editorHighlight {
 
 ///////////////////////////////////////////////// 
 // syntax highlighting declaration
+struct keywordTrie;
+
 struct editorSyntax {
   char *filetype;
   char **extensions;
   char **keywords;
+  char **operators;
   int keywordCount;
   int keywordsCaseSensitive;
   char *lineCommentStart;
   char *blockCommentStart;
   char *blockCommentEnd;
   int flags;
+  struct keywordTrie *trie;   // keywords compiled for lookup, see highlight.c
+  struct keywordTrie *optrie; // and operators
 };
 
 ////////////////////////////////////////
 // text and screen state
+struct rownode;
+
 typedef struct erow {
-  int idx;
-  int size;
+  int size;   // characters in the row, not counting the gap
+  int gap;    // chars is a gap buffer, the gap starts here
+  int gaplen; // and is this long
+  int tabs;   // tabs in the row, -1 until first rendered
   int rsize;
+  int rcap;   // allocated size of render and hl
   char *chars;
   char *render;
   unsigned char *hl;
+  int flags;
   int hl_open_comment;
+  int cacheslot; // where the row sits in E.rowcache, -1 if not rendered
+  unsigned int savegen; // chars is being saved if this is E.savegen
 } erow;
 
+// row flags
+#define ROW_MAPPED (1 << 0) // chars points into E.map
+#define ROW_SHARED (1 << 1) // render points at chars, the row has no tabs
+
+// the i'th character of a row, stepping over the gap
+#define ROW_CHAR(row, i)                                                 \
+  ((i) < (row)->gap ? (row)->chars[(i)] : (row)->chars[(i) + (row)->gaplen])
+
 struct editorConfig {
   int cx, cy;
   int rx;
@@ -125,9 +159,19 @@ struct editorConfig {
   int screenrows;
   int screencols;
   int numrows;
-  erow *row;
+  struct rownode *rowtree; // see rowstore.c
+  int hlfrontier;          // rows before this are lexed
+  int hlresume;            // and these may still be, see editorPrepareRow
+  int hlplain;             // rows on screen went out unhighlighted
+  int hlthread;            // the highlighter thread is running
+  erow **rowcache;         // rendered rows, see rowscreen.c
+  int rowcachesize;
+  int rowcachenext;
   int dirty;
+  unsigned int savegen; // background save in progress, 0 if none
   char *filename;
+  char *map; // the file as loaded, if it could be mapped
+  size_t maplen;
   char statusmsg[80];
   time_t statusmsg_time;
   struct editorSyntax *syntax;
@@ -135,19 +179,15 @@ struct editorConfig {
   int mode;
   int findForward;  // boolean search direction, true forward, false backward
   char *findString; // last used find string
+  int matchrow;     // the find match drawn over the highlight, -1 if none
+  int matchrx;      // where it starts in render
+  int matchlen;
+  int framerate;    // screen updates a second at most, 0 for no limit
+  int esctimeout;   // ms an escape sequence may take to arrive
 };
 
 extern struct editorConfig E;
 
-/*** append buffer ***/
-
-struct abuf {
-  char *b;
-  int len;
-};
-
-#define ABUF_INIT { NULL, 0 }
-
 
 ////////////////////////////////
 // prototypes for foward references